@@ -182,7 +182,9 @@ static bool interpret_cmda(int argc, char *argv[])
     while (next_cmd && strcmp(argv[0], next_cmd->name) != 0)
         next_cmd = next_cmd->next;
     if (next_cmd) {
+        mem_op_begin();
         ok = next_cmd->operation(argc, argv);
+        mem_op_end();
         if (!ok)
             record_error();
     } else {
@@ -397,6 +399,17 @@ static bool do_time(int argc, char *argv[])
     return ok;
 }
 
+static bool do_mem(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    mem_report();
+    return true;
+}
+
 /* Initialize interpreter */
 void init_cmd()
 {
@@ -411,11 +424,15 @@ void init_cmd()
     ADD_COMMAND(source, " file           | Read commands from source file");
     ADD_COMMAND(log, " file           | Copy output to file");
     ADD_COMMAND(time, " cmd arg ...    | Time command execution");
+    ADD_COMMAND(mem,
+                "                | Show memory in use, and used by the last "
+                "command");
     add_cmd("#", do_comment_cmd, " ...            | Display comment");
     add_param("simulation", &simulation, "Start/Stop simulation mode", NULL);
     add_param("verbose", &verblevel, "Verbosity level", NULL);
     add_param("error", &err_limit, "Number of errors until exit", NULL);
     add_param("echo", &echo, "Do/don't echo commands", NULL);
+    add_param("mblimit", &mblimit, "Memory limit in megabytes (0: none)", NULL);
 
     init_in();
     init_time(&last_time);
@@ -0,0 +1,422 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "deque.h"
+#include "harness.h"
+
+/* Number of map entries of a new deque */
+#define DEQUE_MIN_MAP 16
+
+bool deque_init(deque_t *d)
+{
+    d->map = malloc(sizeof(struct deque_chunk *) * DEQUE_MIN_MAP);
+    if (!d->map)
+        return false;
+
+    d->spare = malloc(sizeof(struct deque_chunk));
+    if (!d->spare) {
+        free(d->map);
+        return false;
+    }
+
+    d->cap = DEQUE_MIN_MAP;
+    d->first = d->last = DEQUE_MIN_MAP / 2;
+    d->tree = NULL;
+    d->tree_cap = 0;
+    d->tree_ok = false;
+    return true;
+}
+
+void deque_destroy(deque_t *d)
+{
+    for (size_t m = d->first; m < d->last; m++)
+        free(d->map[m]);
+    free(d->spare);
+    free(d->map);
+    free(d->tree);
+}
+
+/* Add delta to the number of entries of map[m] in the tree, if it is built */
+static inline void tree_add(deque_t *d, size_t m, int delta)
+{
+    if (!d->tree_ok)
+        return;
+
+    for (size_t i = m + 1; i <= d->cap; i += i & -i)
+        d->tree[i - 1] += delta;
+}
+
+/*
+ * Build the tree from the chunks in O(cap).
+ * Return false if could not allocate space.
+ */
+static bool tree_build(deque_t *d)
+{
+    if (d->tree_cap != d->cap) {
+        free(d->tree);
+        d->tree = malloc(sizeof(size_t) * d->cap);
+        if (!d->tree) {
+            d->tree_cap = 0;
+            return false;
+        }
+        d->tree_cap = d->cap;
+    }
+
+    memset(d->tree, 0, sizeof(size_t) * d->cap);
+    for (size_t m = d->first; m < d->last; m++)
+        d->tree[m] = d->map[m]->end - d->map[m]->begin;
+    for (size_t i = 1; i <= d->cap; i++) {
+        size_t j = i + (i & -i);
+        if (j <= d->cap)
+            d->tree[j - 1] += d->tree[i - 1];
+    }
+    d->tree_ok = true;
+    return true;
+}
+
+/*
+ * Return the index in the map of the chunk holding entry n, and set n to the
+ * offset of the entry from the beginning of that chunk. Chunks are walked one
+ * by one if the tree could not be built.
+ */
+static size_t locate(deque_t *d, size_t *n)
+{
+    size_t m;
+
+    if (d->tree_ok || tree_build(d)) {
+        /* Find the longest prefix of the map holding at most n entries */
+        size_t step = 1;
+        while (step <= d->cap / 2)
+            step <<= 1;
+
+        for (m = 0; step; step >>= 1) {
+            if (m + step <= d->cap && d->tree[m + step - 1] <= *n) {
+                m += step;
+                *n -= d->tree[m - 1];
+            }
+        }
+        return m;
+    }
+
+    for (m = d->first; *n >= d->map[m]->end - d->map[m]->begin; m++)
+        *n -= d->map[m]->end - d->map[m]->begin;
+    return m;
+}
+
+/* Return the number of entries in the chunks before map[m] */
+static size_t prefix(deque_t *d, size_t m)
+{
+    size_t n = 0;
+
+    if (d->tree_ok || tree_build(d)) {
+        for (size_t i = m; i; i -= i & -i)
+            n += d->tree[i - 1];
+        return n;
+    }
+
+    for (size_t k = d->first; k < m; k++)
+        n += d->map[k]->end - d->map[k]->begin;
+    return n;
+}
+
+/* Get an empty chunk whose free slots start at slot[at] */
+static struct deque_chunk *chunk_new(deque_t *d, unsigned int at)
+{
+    struct deque_chunk *c = d->spare;
+    if (c)
+        d->spare = NULL;
+    else if (!(c = malloc(sizeof(struct deque_chunk))))
+        return NULL;
+
+    c->begin = c->end = at;
+    return c;
+}
+
+/* Give back a chunk which became empty */
+static void chunk_release(deque_t *d, struct deque_chunk *c)
+{
+    if (!d->spare)
+        d->spare = c;
+    else
+        free(c);
+}
+
+/*
+ * Make room for one more chunk at either end of the map by centering the
+ * chunks in use, after growing the map if it is more than half full.
+ */
+static bool map_make_room(deque_t *d)
+{
+    size_t n = d->last - d->first;
+    size_t cap = d->cap;
+    struct deque_chunk **map = d->map;
+
+    if (2 * (n + 1) > cap) {
+        cap *= 2;
+        map = malloc(sizeof(struct deque_chunk *) * cap);
+        if (!map)
+            return false;
+    }
+
+    /* At least one free entry is left on either side */
+    size_t first = (cap - n) / 2;
+    memmove(map + first, d->map + d->first, sizeof(struct deque_chunk *) * n);
+    if (map != d->map) {
+        free(d->map);
+        d->map = map;
+        d->cap = cap;
+    }
+    d->first = first;
+    d->last = first + n;
+    d->tree_ok = false;
+    return true;
+}
+
+bool deque_push_head(deque_t *d, void *p)
+{
+    struct deque_chunk *c = d->first < d->last ? d->map[d->first] : NULL;
+
+    if (!c || c->begin == 0) {
+        if (d->first == 0 && !map_make_room(d))
+            return false;
+        c = chunk_new(d, c ? DEQUE_CHUNK : DEQUE_CHUNK / 2);
+        if (!c)
+            return false;
+        d->map[--d->first] = c;
+    }
+
+    c->slot[--c->begin] = p;
+    tree_add(d, d->first, 1);
+    return true;
+}
+
+bool deque_push_tail(deque_t *d, void *p)
+{
+    struct deque_chunk *c = d->first < d->last ? d->map[d->last - 1] : NULL;
+
+    if (!c || c->end == DEQUE_CHUNK) {
+        if (d->last == d->cap && !map_make_room(d))
+            return false;
+        c = chunk_new(d, c ? 0 : DEQUE_CHUNK / 2);
+        if (!c)
+            return false;
+        d->map[d->last++] = c;
+    }
+
+    c->slot[c->end++] = p;
+    tree_add(d, d->last - 1, 1);
+    return true;
+}
+
+void *deque_pop_head(deque_t *d)
+{
+    struct deque_chunk *c = d->map[d->first];
+    void *p = c->slot[c->begin++];
+
+    tree_add(d, d->first, -1);
+    if (c->begin == c->end) {
+        d->first++;
+        chunk_release(d, c);
+    }
+    return p;
+}
+
+void *deque_pop_tail(deque_t *d)
+{
+    struct deque_chunk *c = d->map[d->last - 1];
+    void *p = c->slot[--c->end];
+
+    tree_add(d, d->last - 1, -1);
+    if (c->begin == c->end) {
+        d->last--;
+        chunk_release(d, c);
+    }
+    return p;
+}
+
+void *deque_get(deque_t *d, size_t n)
+{
+    size_t m = locate(d, &n);
+    struct deque_chunk *c = d->map[m];
+
+    return c->slot[c->begin + n];
+}
+
+void *deque_erase(deque_t *d, size_t n)
+{
+    size_t m = locate(d, &n);
+    struct deque_chunk *c = d->map[m];
+
+    /* Close the gap from whichever side has fewer entries to move */
+    unsigned int j = c->begin + n;
+    void *p = c->slot[j];
+    if (n < (c->end - c->begin) / 2) {
+        memmove(&c->slot[c->begin + 1], &c->slot[c->begin],
+                sizeof(void *) * n);
+        c->begin++;
+    } else {
+        memmove(&c->slot[j], &c->slot[j + 1],
+                sizeof(void *) * (c->end - j - 1));
+        c->end--;
+    }
+    tree_add(d, m, -1);
+
+    if (c->begin == c->end) {
+        if (m - d->first < d->last - 1 - m) {
+            memmove(d->map + d->first + 1, d->map + d->first,
+                    sizeof(struct deque_chunk *) * (m - d->first));
+            d->first++;
+        } else {
+            memmove(d->map + m, d->map + m + 1,
+                    sizeof(struct deque_chunk *) * (d->last - 1 - m));
+            d->last--;
+        }
+        chunk_release(d, c);
+        d->tree_ok = false;
+    }
+    return p;
+}
+
+void deque_erase_range(deque_t *d, size_t n, size_t k)
+{
+    deque_pos_t rpos, wpos;
+    void **slot;
+
+    wpos.m = locate(d, &n);
+    wpos.i = d->map[wpos.m]->begin + n;
+    rpos = wpos;
+    while (k--)
+        deque_next(d, &rpos);
+
+    while ((slot = deque_next(d, &rpos)))
+        *deque_next(d, &wpos) = *slot;
+    deque_truncate(d, &wpos);
+}
+
+bool deque_insert(deque_t *d, size_t n, void *p)
+{
+    if (!n)
+        return deque_push_head(d, p);
+
+    /* Find the entry p goes after */
+    n--;
+    size_t m = locate(d, &n);
+    struct deque_chunk *c = d->map[m];
+    unsigned int i = c->begin + n + 1;
+
+    if (c->begin == 0 && c->end == DEQUE_CHUNK) {
+        if (i == DEQUE_CHUNK && m == d->last - 1)
+            return deque_push_tail(d, p);
+
+        /* Split the chunk, moving its upper half to a new one after it */
+        if (d->last == d->cap) {
+            size_t first = d->first;
+            if (!map_make_room(d))
+                return false;
+            m = m - first + d->first;
+        }
+        struct deque_chunk *upper = chunk_new(d, 0);
+        if (!upper)
+            return false;
+        memcpy(upper->slot, &c->slot[DEQUE_CHUNK / 2],
+               sizeof(void *) * (DEQUE_CHUNK / 2));
+        upper->end = DEQUE_CHUNK / 2;
+        c->end = DEQUE_CHUNK / 2;
+        memmove(d->map + m + 2, d->map + m + 1,
+                sizeof(struct deque_chunk *) * (d->last - m - 1));
+        d->map[m + 1] = upper;
+        d->last++;
+        d->tree_ok = false;
+
+        if (i > DEQUE_CHUNK / 2) {
+            c = upper;
+            m++;
+            i -= DEQUE_CHUNK / 2;
+        }
+    }
+
+    /* Open a gap at slot i from whichever side has room and fewer entries */
+    if (c->end < DEQUE_CHUNK &&
+        (c->begin == 0 || c->end - i <= i - c->begin)) {
+        memmove(&c->slot[i + 1], &c->slot[i], sizeof(void *) * (c->end - i));
+        c->end++;
+        c->slot[i] = p;
+    } else {
+        memmove(&c->slot[c->begin - 1], &c->slot[c->begin],
+                sizeof(void *) * (i - c->begin));
+        c->begin--;
+        c->slot[i - 1] = p;
+    }
+    tree_add(d, m, 1);
+    return true;
+}
+
+size_t deque_search(deque_t *d, const void *key, deque_cmp_t cmp, bool upper)
+{
+    /* Entries before the bound compare at most this way with key */
+    int limit = upper ? 0 : -1;
+
+    /* Find the first chunk whose first entry is not before the bound */
+    size_t lo = d->first, hi = d->last;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        struct deque_chunk *c = d->map[mid];
+        if (cmp(c->slot[c->begin], key) <= limit)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == d->first)
+        return 0;
+
+    /* The bound is within the chunk before, or right after its end */
+    size_t m = lo - 1;
+    struct deque_chunk *c = d->map[m];
+    unsigned int i = c->begin + 1, j = c->end;
+    while (i < j) {
+        unsigned int mid = i + (j - i) / 2;
+        if (cmp(c->slot[mid], key) <= limit)
+            i = mid + 1;
+        else
+            j = mid;
+    }
+    return prefix(d, m) + (i - c->begin);
+}
+
+void deque_reverse(deque_t *d)
+{
+    d->tree_ok = false;
+    for (size_t lo = d->first, hi = d->last; lo + 1 < hi; lo++, hi--) {
+        struct deque_chunk *t = d->map[lo];
+        d->map[lo] = d->map[hi - 1];
+        d->map[hi - 1] = t;
+    }
+
+    /* Mirror every chunk, so that free slots at its front move to its back */
+    for (size_t m = d->first; m < d->last; m++) {
+        struct deque_chunk *c = d->map[m];
+        for (unsigned int i = 0; i < DEQUE_CHUNK / 2; i++) {
+            void *t = c->slot[i];
+            c->slot[i] = c->slot[DEQUE_CHUNK - 1 - i];
+            c->slot[DEQUE_CHUNK - 1 - i] = t;
+        }
+        unsigned int begin = c->begin;
+        c->begin = DEQUE_CHUNK - c->end;
+        c->end = DEQUE_CHUNK - begin;
+    }
+}
+
+void deque_truncate(deque_t *d, const deque_pos_t *pos)
+{
+    size_t m = pos->m;
+    if (m >= d->last)
+        return;
+
+    struct deque_chunk *c = d->map[m];
+    c->end = pos->i;
+
+    size_t keep = c->begin == c->end ? m : m + 1;
+    d->tree_ok = false;
+    while (d->last > keep)
+        chunk_release(d, d->map[--d->last]);
+}
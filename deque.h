@@ -0,0 +1,147 @@
+#ifndef LAB0_DEQUE_H
+#define LAB0_DEQUE_H
+
+/*
+ * Deque of pointers stored in fixed-size chunks, a.k.a. an unrolled list.
+ *
+ * The chunks are referenced from a map which keeps them in order, so pointers
+ * sit next to each other in memory: a walk over the deque touches one cache
+ * line per eight entries instead of one per entry. A chunk may be partially
+ * filled, which lets entries be erased from the middle by moving at most
+ * DEQUE_CHUNK / 2 pointers.
+ *
+ * Entries are looked up by index through a Fenwick tree over the number of
+ * entries of each map slot. It is only built by the first such lookup, so
+ * deques which are never indexed do not pay for keeping it.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Number of pointers in a chunk */
+#define DEQUE_CHUNK 64
+
+struct deque_chunk {
+    unsigned int begin, end; /* Occupied slots are slot[begin .. end - 1] */
+    void *slot[DEQUE_CHUNK];
+};
+
+typedef struct {
+    struct deque_chunk **map;
+    size_t cap;         /* Number of entries of map */
+    size_t first, last; /* Chunks in use are map[first .. last - 1] */
+    /* Empty chunk kept around, so that pushing and popping back and forth
+     * across a chunk boundary does not hit the allocator every time
+     */
+    struct deque_chunk *spare;
+    /* Fenwick tree over the number of entries in map[0 .. cap - 1]. It is
+     * kept up to date by pushes and pops, and rebuilt on the next lookup once
+     * chunks have moved in the map.
+     */
+    size_t *tree;
+    size_t tree_cap; /* Number of entries of tree */
+    bool tree_ok;
+} deque_t;
+
+/* Position of an entry in a deque */
+typedef struct {
+    size_t m;       /* Index of the chunk in the map */
+    unsigned int i; /* Index of the slot in the chunk */
+} deque_pos_t;
+
+/*
+ * Initialize an empty deque.
+ * Return false if could not allocate space.
+ */
+bool deque_init(deque_t *d);
+
+/* Free all storage used by the deque */
+void deque_destroy(deque_t *d);
+
+/*
+ * Add p at the head (tail) of the deque.
+ * Return false if could not allocate space.
+ */
+bool deque_push_head(deque_t *d, void *p);
+bool deque_push_tail(deque_t *d, void *p);
+
+/*
+ * Remove the entry at the head (tail) of the deque and return it.
+ * The deque must not be empty.
+ */
+void *deque_pop_head(deque_t *d);
+void *deque_pop_tail(deque_t *d);
+
+/*
+ * Return the entry with 0-based index n.
+ * Cost is O(log n), plus a rebuild of the tree in O(n / DEQUE_CHUNK) if the
+ * chunks have moved since the last lookup. The deque must hold more than n
+ * entries.
+ */
+void *deque_get(deque_t *d, size_t n);
+
+/*
+ * Remove the entry with 0-based index n and return it.
+ * Cost is the one of deque_get() plus O(DEQUE_CHUNK). The deque must hold more
+ * than n entries.
+ */
+void *deque_erase(deque_t *d, size_t n);
+
+/*
+ * Remove the k entries from 0-based index n on, by moving the ones behind
+ * them. The deque must hold at least n + k entries, with k > 0.
+ */
+void deque_erase_range(deque_t *d, size_t n, size_t k);
+
+/*
+ * Insert p so that it gets 0-based index n, where n is at most the number of
+ * entries. Cost is the one of deque_erase(), plus a split of the chunk in two
+ * when it is full.
+ * Return false if could not allocate space.
+ */
+bool deque_insert(deque_t *d, size_t n, void *p);
+
+/* Compare entry with key like strcmp() */
+typedef int (*deque_cmp_t)(const void *entry, const void *key);
+
+/*
+ * In a deque whose entries are in ascending order by cmp, return the index of
+ * the first entry comparing above key, or not below key unless upper. That is
+ * the number of entries if there is none. Chunks are binary searched by their
+ * first entry, so cmp is called O(log n) times.
+ */
+size_t deque_search(deque_t *d, const void *key, deque_cmp_t cmp, bool upper);
+
+/* Reverse the order of the entries */
+void deque_reverse(deque_t *d);
+
+/*
+ * Drop all entries from pos on, where pos was obtained by walking the deque
+ * with deque_next(). Chunks left empty are released.
+ */
+void deque_truncate(deque_t *d, const deque_pos_t *pos);
+
+/* Set pos to the first entry of the deque */
+static inline void deque_rewind(const deque_t *d, deque_pos_t *pos)
+{
+    pos->m = d->first;
+    pos->i = d->first < d->last ? d->map[d->first]->begin : 0;
+}
+
+/*
+ * Return the slot of the entry at pos and advance pos to the next entry.
+ * Return NULL once the end of the deque is reached.
+ */
+static inline void **deque_next(const deque_t *d, deque_pos_t *pos)
+{
+    while (pos->m < d->last) {
+        struct deque_chunk *c = d->map[pos->m];
+        if (pos->i < c->end)
+            return &c->slot[pos->i++];
+        if (++pos->m < d->last)
+            pos->i = d->map[pos->m]->begin;
+    }
+    return NULL;
+}
+
+#endif /* LAB0_DEQUE_H */
@@ -1,10 +1,14 @@
 /* Test support code */
 
+#include <pthread.h>
+#include <malloc.h>
 #include <setjmp.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include "report.h"
@@ -24,80 +28,395 @@
 /* Value at end of every block */
 #define MAGICFOOTER 0xbeefdead
 
+/* Value at start of every block allocated in fast mode */
+#define MAGICFAST 0xfa57b10c
+
 /* Byte to fill newly malloced space with */
 #define FILLCHAR 0x55
 
 /* Data structures used by our code */
 
+/* Number of buckets of the allocation lifetime histograms */
+#define LIFETIME_BUCKETS 32
+
 /*
- * Represent allocated blocks as doubly-linked list, with
- * next and prev pointers at beginning
+ * Allocation statistics of one call site.
+ * Lifetimes are measured in allocations made by the harness in the
+ * meantime, which keeps them deterministic, and bucket k of the histogram
+ * counts blocks freed after living at least 2^(k-1) and less than 2^k.
+ * Counters are updated with atomic operations, so that threads allocating
+ * from the same site do not lose counts.
  */
+struct alloc_site {
+    const char *file; /* NULL for an unused entry */
+    int line;
+    size_t allocs, frees;
+    size_t bytes;      /* Bytes allocated in total */
+    size_t live_bytes; /* Bytes currently allocated */
+    size_t peak_bytes; /* Highest value of live_bytes */
+    size_t lifetime[LIFETIME_BUCKETS];
+};
+
+/* Number of call sites told apart; any further ones share the last entry */
+#define MAX_SITES 256
+
+static struct alloc_site sites[MAX_SITES];
+static size_t nsites = 0;
+static struct alloc_site other_sites = {.file = "(other)"};
+
+/* Serializes the creation of new sites; lookups take no lock */
+static pthread_mutex_t sites_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Number of allocations made so far, the clock of lifetimes */
+static size_t alloc_clock = 0;
+
 typedef struct BELE {
-    struct BELE *next, *prev;
+    struct alloc_site *site; /* Where the block was allocated */
+    size_t born;             /* Value of alloc_clock when allocated */
+    void *map;               /* Mapping holding the block, NULL if malloced */
+    size_t map_len;
     size_t payload_size;
     size_t magic_header; /* Marker to see if block seems legitimate */
     unsigned char payload[0];
     /* Also place magic number at tail of every block */
 } block_ele_t;
 
-static block_ele_t *allocated = NULL;
-static size_t allocated_count = 0;
+/*
+ * Header of blocks allocated in fast mode.  These are only counted, so it
+ * just keeps the payload aligned and ends with a magic number, in the same
+ * place as in block_ele_t, to tell the two kinds apart.
+ */
+typedef struct {
+    size_t payload_size;
+    size_t magic_header;
+    unsigned char payload[0];
+} fast_ele_t;
+
+int fast_mode = 0;
+static size_t fast_count = 0; /* Blocks allocated in fast mode */
+
+/*
+ * Allocated blocks are kept in a hash set keyed by their address, using open
+ * addressing with linear probing, so that checking that a block being freed
+ * is really allocated takes O(1) however many blocks there are.
+ *
+ * So that threads allocating at the same time rarely wait for each other,
+ * the set is split into 2^BLOCK_SHARD_BITS shards, each with its own lock
+ * and table, and the address of a block decides which shard tracks it.
+ * Splitting by address rather than by thread lets any thread free a block
+ * allocated by another one.
+ * Each table has 2^bits slots and is kept between 1/8 and 1/2 full.
+ */
+#define BLOCK_SHARD_BITS 4
+#define BLOCK_SHARDS (1 << BLOCK_SHARD_BITS)
+
+struct block_shard {
+    pthread_mutex_t lock;
+    block_ele_t **blocks;
+    unsigned int bits;
+    size_t count;
+} __attribute__((aligned(64))); /* Keep shards on separate cache lines */
+
+static struct block_shard shards[BLOCK_SHARDS] = {
+    [0 ... BLOCK_SHARDS - 1] = {.lock = PTHREAD_MUTEX_INITIALIZER},
+};
+
+/* Smallest table ever allocated */
+#define BLOCKS_MIN_BITS 6
+
+/*
+ * In guard mode, each block gets its own mapping with an inaccessible page
+ * right after its payload, or right before its header, so that running
+ * past the block faults on the spot instead of being found at free time.
+ * Payloads keep the alignment malloc gives, so an overrun shorter than the
+ * footer and the padding up to the guard page is still only caught, if at
+ * all, by the footer check.
+ * Freed mappings are made inaccessible too, to catch uses after free, and
+ * are unmapped GUARD_BATCH at a time.
+ */
+int guard_pages = GUARD_OFF;
+
+#define GUARD_ALIGN 16
+#define GUARD_BATCH 64
+
+static struct {
+    void *map;
+    size_t len;
+} guard_freed[GUARD_BATCH];
+static int guard_nfreed = 0;
+static pthread_mutex_t guard_lock = PTHREAD_MUTEX_INITIALIZER;
 
-/* Percent probability of malloc failure */
+/* Fault injection schedule, see fail_allocation() */
 int fail_probability = 0;
+int fail_basis_points = 0;
+int fail_every = 0;
+int fail_min_size = 0;
+static char *fail_file = NULL;
+static int fail_line = 0;
+int fail_seed = 1;
+
+/*
+ * Each thread draws from its own generator, seeded from fail_seed and the
+ * order in which threads first allocated since the schedule was restarted.
+ * A thread whose generation differs from fail_gen seeds itself again.
+ */
+static unsigned int fail_gen = 1;
+static unsigned int fail_threads = 0;
+static size_t fail_count = 0; /* Allocations eligible to fail so far */
+static __thread unsigned int fail_gen_seen = 0;
+static __thread uint64_t fail_state;
 
-static bool cautious_mode = true;
 static bool noallocate_mode = false;
+static bool nomalloc_mode = false;
 static bool error_occurred = false;
-static char *error_message = "";
 
 static int time_limit = 1;
 
 /*
- * Data for managing exceptions
+ * Data for managing exceptions.
+ * Each thread has its own, so that a thread running risky code returns to
+ * its own exception setup.
  */
-static jmp_buf env;
-static volatile sig_atomic_t jmp_ready = false;
-static bool time_limited = false;
+static __thread char *error_message = "";
+static __thread jmp_buf env;
+static __thread volatile sig_atomic_t jmp_ready = false;
+static __thread bool time_limited = false;
 
 /*
  * Internal functions
  */
 
-/* Should this allocation fail? */
-static bool fail_allocation()
+/* Record that an error occurred, whichever thread found it */
+static inline void set_error()
 {
-    double weight = (double) random() / RAND_MAX;
-    return (weight < 0.01 * fail_probability);
+    __atomic_store_n(&error_occurred, true, __ATOMIC_RELAXED);
+}
+
+/* Next number of the calling thread's generator (SplitMix64) */
+static inline uint64_t fail_random()
+{
+    unsigned int gen = __atomic_load_n(&fail_gen, __ATOMIC_RELAXED);
+
+    if (fail_gen_seen != gen) {
+        uint64_t nth = __atomic_fetch_add(&fail_threads, 1, __ATOMIC_RELAXED);
+        fail_state = (uint64_t) fail_seed + nth * 0xD1B54A32D192ED03ULL;
+        fail_gen_seen = gen;
+    }
+
+    uint64_t z = (fail_state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * Should this allocation fail?
+ * Only allocations of at least fail_min_size bytes, ignored when 0, made at
+ * the call site fail_file:fail_line, if set, are eligible.  Of these, every
+ * fail_every-th one fails, and any one fails with probability
+ * fail_probability percent plus fail_basis_points hundredths of a percent.
+ * When neither is set, all eligible allocations fail.
+ */
+static bool fail_allocation(size_t size, const char *file, int line)
+{
+    bool filtered = fail_min_size > 0 || fail_file;
+    uint64_t bp = (uint64_t) fail_probability * 100 + fail_basis_points;
+
+    if (!filtered && !fail_every && !bp)
+        return false;
+
+    if ((fail_min_size > 0 && size < (size_t) fail_min_size) ||
+        (fail_file &&
+         (line != fail_line || !file || strcmp(file, fail_file))))
+        return false;
+
+    if (!fail_every && !bp)
+        return true;
+
+    if (fail_every > 0 &&
+        (__atomic_add_fetch(&fail_count, 1, __ATOMIC_RELAXED) %
+         (size_t) fail_every) == 0)
+        return true;
+
+    /* Scale 32 random bits to [0, 10000) without dividing */
+    return bp && ((fail_random() >> 32) * 10000 >> 32) < bp;
+}
+
+bool fail_at_site(const char *file, int line)
+{
+    char *copy = NULL;
+
+    if (file && !(copy = strdup(file)))
+        return false;
+    free(fail_file);
+    fail_file = copy;
+    fail_line = line;
+    return true;
+}
+
+void fail_restart()
+{
+    __atomic_store_n(&fail_count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&fail_threads, 0, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&fail_gen, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Count size more bytes as allocated, against the memory limit.
+ * Signal error and return false if that would exceed it.
+ */
+static bool reserve_bytes(size_t size)
+{
+    if (mem_reserve(size))
+        return true;
+
+    report_event(MSG_ERROR, "Exceeded memory limit of %d megabytes",
+                 mblimit);
+    set_error();
+    return false;
 }
 
 /*
- * Find header of block, given its payload.
- * Signal error if doesn't seem like legitimate block
+ * Find the statistics of call site file:line, creating them if needed.
+ * Sites are hashed by line number, as file names are few.
+ * Entries are never removed and their file is set last, so an entry whose
+ * file is seen set is complete and a lookup needs no lock.
  */
-static block_ele_t *find_header(void *p)
+static struct alloc_site *find_site(const char *file, int line)
+{
+    size_t i = ((unsigned int) line * 0x9E3779B1U) % MAX_SITES;
+    bool locked = false;
+
+    if (!file)
+        file = "(unknown)";
+
+    for (size_t n = 0; n < MAX_SITES; n++, i = (i + 1) % MAX_SITES) {
+        struct alloc_site *site = &sites[i];
+        const char *f = __atomic_load_n(&site->file, __ATOMIC_ACQUIRE);
+        if (!f && !locked) {
+            /* Look again under the lock, in case another thread is
+             * creating the entry right now
+             */
+            pthread_mutex_lock(&sites_lock);
+            locked = true;
+            f = site->file;
+        }
+        if (!f) {
+            if (nsites == MAX_SITES - 1)
+                break;
+            nsites++;
+            site->line = line;
+            __atomic_store_n(&site->file, file, __ATOMIC_RELEASE);
+            pthread_mutex_unlock(&sites_lock);
+            return site;
+        }
+        if (site->line == line && (f == file || !strcmp(f, file))) {
+            if (locked)
+                pthread_mutex_unlock(&sites_lock);
+            return site;
+        }
+    }
+
+    /* Table full, lump the site with the others left over */
+    if (locked)
+        pthread_mutex_unlock(&sites_lock);
+    return &other_sites;
+}
+
+/* Fibonacci hash of block b; the top bits select its shard */
+static inline uint64_t block_mix(const block_ele_t *b)
+{
+    return (uint64_t) (uintptr_t) b * 0x9E3779B97F4A7C15ULL;
+}
+
+/* Shard tracking block b */
+static inline struct block_shard *block_shard(const block_ele_t *b)
+{
+    return &shards[block_mix(b) >> (64 - BLOCK_SHARD_BITS)];
+}
+
+/* Home slot of block b in the table of shard s, from the next bits */
+static inline size_t block_hash(const struct block_shard *s,
+                                const block_ele_t *b)
+{
+    return (size_t) ((block_mix(b) << BLOCK_SHARD_BITS) >> (64 - s->bits));
+}
+
+/* Return the slot holding block b, or the empty slot where it would go */
+static size_t block_slot(const struct block_shard *s, const block_ele_t *b)
+{
+    size_t mask = ((size_t) 1 << s->bits) - 1;
+    size_t i = block_hash(s, b);
+
+    while (s->blocks[i] && s->blocks[i] != b)
+        i = (i + 1) & mask;
+    return i;
+}
+
+/*
+ * Move the blocks of shard s to a table of 2^bits slots.
+ * Return false, keeping the current table, if could not allocate it.
+ */
+static bool blocks_resize(struct block_shard *s, unsigned int bits)
+{
+    block_ele_t **old = s->blocks;
+    size_t old_cap = old ? (size_t) 1 << s->bits : 0;
+
+    s->blocks = calloc((size_t) 1 << bits, sizeof(block_ele_t *));
+    if (!s->blocks) {
+        s->blocks = old;
+        return false;
+    }
+
+    s->bits = bits;
+    for (size_t i = 0; i < old_cap; i++)
+        if (old[i])
+            s->blocks[block_slot(s, old[i])] = old[i];
+    free(old);
+    return true;
+}
+
+/*
+ * Empty slot i of the table of shard s, shifting back the blocks further
+ * along its probe sequence so that no lookup stops short of them.
+ */
+static void blocks_delete(struct block_shard *s, size_t i)
+{
+    block_ele_t **blocks = s->blocks;
+    size_t mask = ((size_t) 1 << s->bits) - 1;
+
+    for (size_t j = (i + 1) & mask; blocks[j]; j = (j + 1) & mask) {
+        /* blocks[j] may move to the hole unless its home slot lies
+         * cyclically between the hole and j
+         */
+        if (((j - block_hash(s, blocks[j])) & mask) >= ((j - i) & mask)) {
+            blocks[i] = blocks[j];
+            i = j;
+        }
+    }
+    blocks[i] = NULL;
+}
+
+/*
+ * Find header of block, given its payload, and the slot of the table of
+ * shard s holding it.  The lock of s must be held.
+ * Signal error and return NULL if doesn't seem like legitimate block
+ */
+static block_ele_t *find_header(void *p, struct block_shard *s, size_t *slot)
 {
     if (!p) {
         report_event(MSG_ERROR, "Attempting to free null block");
-        error_occurred = true;
+        set_error();
     }
 
     block_ele_t *b = (block_ele_t *) ((size_t) p - sizeof(block_ele_t));
-    if (cautious_mode) {
-        /* Make sure this is really an allocated block */
-        block_ele_t *ab = allocated;
-        bool found = false;
-        while (ab && !found) {
-            found = ab == b;
-            ab = ab->next;
-        }
-        if (!found) {
-            report_event(MSG_ERROR,
-                         "Attempted to free unallocated block.  Address = %p",
-                         p);
-            error_occurred = true;
-        }
+
+    /* Make sure this is really an allocated block */
+    if (!s->blocks || !s->blocks[*slot = block_slot(s, b)]) {
+        report_event(MSG_ERROR,
+                     "Attempted to free unallocated block.  Address = %p", p);
+        set_error();
+        return NULL;
     }
 
     if (b->magic_header != MAGICHEADER) {
@@ -105,12 +424,82 @@ static block_ele_t *find_header(void *p)
             MSG_ERROR,
             "Attempted to free unallocated or corrupted block.  Address = %p",
             p);
-        error_occurred = true;
+        set_error();
     }
 
     return b;
 }
 
+static size_t page_size()
+{
+    static size_t size = 0;
+
+    if (!size)
+        size = sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+/*
+ * Get memory for a block with size bytes of payload, placed against a
+ * guard page in guard mode.  Return NULL if none is left.
+ */
+static block_ele_t *block_alloc(size_t size)
+{
+    size_t need = sizeof(block_ele_t) + size + sizeof(size_t);
+
+    if (guard_pages == GUARD_OFF) {
+        block_ele_t *b = malloc(need);
+        if (b)
+            b->map = NULL;
+        return b;
+    }
+
+    size_t page = page_size();
+    size_t len = ((need + GUARD_ALIGN - 1 + page - 1) & ~(page - 1)) + page;
+    char *map = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    block_ele_t *b;
+    if (guard_pages == GUARD_BEFORE) {
+        mprotect(map, page, PROT_NONE);
+        b = (block_ele_t *) (map + page);
+    } else {
+        char *guard = map + len - page;
+        mprotect(guard, page, PROT_NONE);
+        uintptr_t payload = ((uintptr_t) guard - size - sizeof(size_t)) &
+                            ~(uintptr_t) (GUARD_ALIGN - 1);
+        b = (block_ele_t *) (payload - sizeof(block_ele_t));
+    }
+    b->map = map;
+    b->map_len = len;
+    return b;
+}
+
+/* Give back the memory of a block no longer tracked */
+static void block_release(block_ele_t *b)
+{
+    if (!b->map) {
+        free(b);
+        return;
+    }
+
+    void *map = b->map;
+    size_t len = b->map_len;
+    mprotect(map, len, PROT_NONE);
+
+    pthread_mutex_lock(&guard_lock);
+    guard_freed[guard_nfreed].map = map;
+    guard_freed[guard_nfreed].len = len;
+    if (++guard_nfreed == GUARD_BATCH) {
+        for (int i = 0; i < GUARD_BATCH; i++)
+            munmap(guard_freed[i].map, guard_freed[i].len);
+        guard_nfreed = 0;
+    }
+    pthread_mutex_unlock(&guard_lock);
+}
+
 /* Given pointer to block, find its footer */
 static size_t *find_footer(block_ele_t *b)
 {
@@ -124,21 +513,37 @@ static size_t *find_footer(block_ele_t *b)
  */
 void *test_malloc(size_t size)
 {
-    if (noallocate_mode) {
-        report_event(MSG_FATAL, "Calls to malloc disallowed");
-        return NULL;
-    }
+    return test_malloc_at(size, NULL, 0);
+}
 
-    if (fail_allocation()) {
-        report_event(MSG_WARN, "Malloc returning NULL");
+/*
+ * Allocate a checked block of size bytes for the call site file:line, as
+ * test_malloc_at() does once past fault injection.  Return its payload, or
+ * NULL if could not allocate space.
+ */
+static void *new_payload(size_t size, const char *file, int line)
+{
+    if (!reserve_bytes(size))
         return NULL;
+
+    if (fast_mode && guard_pages == GUARD_OFF) {
+        fast_ele_t *f = malloc(sizeof(fast_ele_t) + size);
+        if (!f) {
+            report_event(MSG_FATAL, "Couldn't allocate any more memory");
+            set_error();
+        }
+        // cppcheck-suppress nullPointerRedundantCheck
+        f->payload_size = size;
+        // cppcheck-suppress nullPointerRedundantCheck
+        f->magic_header = MAGICFAST;
+        __atomic_fetch_add(&fast_count, 1, __ATOMIC_RELAXED);
+        return (void *) &f->payload;
     }
 
-    block_ele_t *new_block =
-        malloc(size + sizeof(block_ele_t) + sizeof(size_t));
+    block_ele_t *new_block = block_alloc(size);
     if (!new_block) {
         report_event(MSG_FATAL, "Couldn't allocate any more memory");
-        error_occurred = true;
+        set_error();
     }
 
     // cppcheck-suppress nullPointerRedundantCheck
@@ -148,19 +553,61 @@ void *test_malloc(size_t size)
     *find_footer(new_block) = MAGICFOOTER;
     void *p = (void *) &new_block->payload;
     memset(p, FILLCHAR, size);
-    // cppcheck-suppress nullPointerRedundantCheck
-    new_block->next = allocated;
-    // cppcheck-suppress nullPointerRedundantCheck
-    new_block->prev = NULL;
 
-    if (allocated)
-        allocated->prev = new_block;
-    allocated = new_block;
-    allocated_count++;
+    struct alloc_site *site = find_site(file, line);
+    new_block->site = site;
+    new_block->born = __atomic_fetch_add(&alloc_clock, 1, __ATOMIC_RELAXED);
+
+    struct block_shard *s = block_shard(new_block);
+    pthread_mutex_lock(&s->lock);
+    /* Keep the table at most half full */
+    bool tracked = 2 * (s->count + 1) <= ((size_t) 1 << s->bits) ||
+                   blocks_resize(s, s->blocks ? s->bits + 1 : BLOCKS_MIN_BITS);
+    if (tracked) {
+        s->blocks[block_slot(s, new_block)] = new_block;
+        s->count++;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    /* Without room to track the block, fail like malloc() would */
+    if (!tracked) {
+        block_release(new_block);
+        mem_release(size);
+        report_event(MSG_WARN, "Malloc returning NULL");
+        return NULL;
+    }
+
+    __atomic_fetch_add(&site->allocs, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site->bytes, size, __ATOMIC_RELAXED);
+    raise_peak(&site->peak_bytes,
+               __atomic_add_fetch(&site->live_bytes, size, __ATOMIC_RELAXED));
 
     return p;
 }
 
+void *test_malloc_at(size_t size, const char *file, int line)
+{
+    if (noallocate_mode || nomalloc_mode) {
+        report_event(MSG_FATAL, "Calls to malloc disallowed");
+        return NULL;
+    }
+
+    if (fail_allocation(size, file, line)) {
+        report_event(MSG_WARN, "Malloc returning NULL");
+        return NULL;
+    }
+
+    return new_payload(size, file, line);
+}
+
+bool test_fail_at(size_t size, const char *file, int line)
+{
+    if (!fail_allocation(size, file, line))
+        return false;
+    report_event(MSG_WARN, "Malloc returning NULL");
+    return true;
+}
+
 // cppcheck-suppress unusedFunction
 void *test_calloc(size_t nelem, size_t elsize)
 {
@@ -183,38 +630,181 @@ void test_free(void *p)
     if (!p)
         return;
 
-    block_ele_t *b = find_header(p);
+    fast_ele_t *f = (fast_ele_t *) ((size_t) p - sizeof(fast_ele_t));
+    if (f->magic_header == MAGICFAST) {
+        f->magic_header = MAGICFREE;
+        mem_release(f->payload_size);
+        free(f);
+        __atomic_fetch_sub(&fast_count, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    block_ele_t *hdr = (block_ele_t *) ((size_t) p - sizeof(block_ele_t));
+    struct block_shard *s = block_shard(hdr);
+    size_t slot;
+
+    /* Hold the lock of the shard until the block is out of it, so that
+     * freeing the same block twice from two threads is caught
+     */
+    pthread_mutex_lock(&s->lock);
+    block_ele_t *b = find_header(p, s, &slot);
+    if (!b) {
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+
     size_t footer = *find_footer(b);
     if (footer != MAGICFOOTER) {
         report_event(MSG_ERROR,
                      "Corruption detected in block with address %p when "
                      "attempting to free it",
                      p);
-        error_occurred = true;
+        set_error();
     }
     b->magic_header = MAGICFREE;
     *find_footer(b) = MAGICFREE;
+
+    blocks_delete(s, slot);
+    s->count--;
+
+    /* Give back most of the table once most blocks are gone */
+    if (s->bits > BLOCKS_MIN_BITS && 8 * s->count < ((size_t) 1 << s->bits))
+        blocks_resize(s, s->bits - 1);
+    pthread_mutex_unlock(&s->lock);
     memset(p, FILLCHAR, b->payload_size);
+    mem_release(b->payload_size);
+
+    struct alloc_site *site = b->site;
+    size_t age = __atomic_load_n(&alloc_clock, __ATOMIC_RELAXED) - b->born;
+    int k = age ? 64 - __builtin_clzll(age) : 0;
+    __atomic_fetch_add(&site->frees, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&site->live_bytes, b->payload_size, __ATOMIC_RELAXED);
+    __atomic_fetch_add(
+        &site->lifetime[k < LIFETIME_BUCKETS ? k : LIFETIME_BUCKETS - 1], 1,
+        __ATOMIC_RELAXED);
+    block_release(b);
+}
 
-    /* Unlink from list */
-    block_ele_t *bn = b->next;
-    block_ele_t *bp = b->prev;
-    if (bp)
-        bp->next = bn;
-    else
-        allocated = bn;
-    if (bn)
-        bn->prev = bp;
+// cppcheck-suppress unusedFunction
+void *test_realloc(void *p, size_t size)
+{
+    return test_realloc_at(p, size, NULL, 0);
+}
+
+void *test_realloc_at(void *p, size_t size, const char *file, int line)
+{
+    if (!p)
+        return test_malloc_at(size, file, line);
+
+    if (!size) {
+        test_free(p);
+        return NULL;
+    }
+
+    if (noallocate_mode || nomalloc_mode) {
+        report_event(MSG_FATAL, "Calls to realloc disallowed");
+        return NULL;
+    }
+
+    /* A failing realloc leaves the block as it is */
+    if (fail_allocation(size, file, line)) {
+        report_event(MSG_WARN, "Realloc returning NULL");
+        return NULL;
+    }
+
+    fast_ele_t *f = (fast_ele_t *) ((size_t) p - sizeof(fast_ele_t));
+    if (f->magic_header == MAGICFAST) {
+        size_t old_size = f->payload_size;
+        if (size > old_size && !reserve_bytes(size - old_size))
+            return NULL;
+        fast_ele_t *new = realloc(f, sizeof(fast_ele_t) + size);
+        if (!new) {
+            if (size > old_size)
+                mem_release(size - old_size);
+            return NULL;
+        }
+        if (size < old_size)
+            mem_release(old_size - size);
+        new->payload_size = size;
+        return (void *) &new->payload;
+    }
+
+    block_ele_t *hdr = (block_ele_t *) ((size_t) p - sizeof(block_ele_t));
+    struct block_shard *s = block_shard(hdr);
+    size_t slot;
+
+    pthread_mutex_lock(&s->lock);
+    block_ele_t *b = find_header(p, s, &slot);
+    if (!b) {
+        pthread_mutex_unlock(&s->lock);
+        return NULL;
+    }
+
+    if (*find_footer(b) != MAGICFOOTER) {
+        pthread_mutex_unlock(&s->lock);
+        report_event(MSG_ERROR,
+                     "Corruption detected in block with address %p when "
+                     "attempting to reallocate it",
+                     p);
+        set_error();
+        return NULL;
+    }
+
+    /* Resize in place when the slack left by malloc holds the new size,
+     * which always is the case when shrinking.  Blocks in guard mode
+     * always move, to stay against their guard page.
+     */
+    size_t old_size = b->payload_size;
+    if (!b->map &&
+        size + sizeof(block_ele_t) + sizeof(size_t) <= malloc_usable_size(b)) {
+        if (size > old_size && !reserve_bytes(size - old_size)) {
+            pthread_mutex_unlock(&s->lock);
+            return NULL;
+        }
+        b->payload_size = size;
+        *find_footer(b) = MAGICFOOTER;
+        pthread_mutex_unlock(&s->lock);
+        if (size > old_size)
+            memset((char *) p + old_size, FILLCHAR, size - old_size);
+
+        struct alloc_site *site = b->site;
+        if (size > old_size) {
+            __atomic_fetch_add(&site->bytes, size - old_size,
+                               __ATOMIC_RELAXED);
+            raise_peak(&site->peak_bytes,
+                       __atomic_add_fetch(&site->live_bytes, size - old_size,
+                                          __ATOMIC_RELAXED));
+        } else {
+            __atomic_fetch_sub(&site->live_bytes, old_size - size,
+                               __ATOMIC_RELAXED);
+            mem_release(old_size - size);
+        }
+        return p;
+    }
+    pthread_mutex_unlock(&s->lock);
 
-    free(b);
-    allocated_count--;
+    /* Otherwise move it to a new block, as counted from this call site.
+     * The schedule was drawn from above already, so a moved block takes
+     * the same single draw as one resized in place.
+     */
+    void *new = new_payload(size, file, line);
+    if (!new)
+        return NULL;
+    memcpy(new, p, size < old_size ? size : old_size);
+    test_free(p);
+    return new;
 }
 
 // cppcheck-suppress unusedFunction
 char *test_strdup(const char *s)
+{
+    return test_strdup_at(s, NULL, 0);
+}
+
+char *test_strdup_at(const char *s, const char *file, int line)
 {
     size_t len = strlen(s) + 1;
-    void *new = test_malloc(len);
+    void *new = test_malloc_at(len, file, line);
     if (!new)
         return NULL;
 
@@ -223,7 +813,59 @@ char *test_strdup(const char *s)
 
 size_t allocation_check()
 {
-    return allocated_count;
+    size_t count = 0;
+
+    for (int i = 0; i < BLOCK_SHARDS; i++)
+        count += __atomic_load_n(&shards[i].count, __ATOMIC_RELAXED);
+    return count + __atomic_load_n(&fast_count, __ATOMIC_RELAXED);
+}
+
+/* Order sites by decreasing number of bytes allocated */
+static int cmp_site(const void *a, const void *b)
+{
+    const struct alloc_site *sa = *(const struct alloc_site **) a;
+    const struct alloc_site *sb = *(const struct alloc_site **) b;
+    return (sa->bytes < sb->bytes) - (sa->bytes > sb->bytes);
+}
+
+void allocation_profile(bool reset)
+{
+    struct alloc_site *list[MAX_SITES + 1];
+    size_t n = 0;
+
+    for (size_t i = 0; i < MAX_SITES; i++)
+        if (sites[i].file)
+            list[n++] = &sites[i];
+    list[n++] = &other_sites;
+    qsort(list, n, sizeof(list[0]), cmp_site);
+
+    if (reset) {
+        for (size_t i = 0; i < n; i++) {
+            struct alloc_site *site = list[i];
+            site->allocs = site->frees = site->bytes = 0;
+            site->peak_bytes = site->live_bytes;
+            memset(site->lifetime, 0, sizeof(site->lifetime));
+        }
+        return;
+    }
+
+    report(1, "%-20s %10s %10s %12s %12s  %s", "site", "allocs", "frees",
+           "bytes", "peak live", "lifetime (allocations: frees)");
+    for (size_t i = 0; i < n; i++) {
+        struct alloc_site *site = list[i];
+        char name[32];
+
+        if (!site->allocs && !site->frees)
+            continue;
+        snprintf(name, sizeof(name), "%s:%d", site->file, site->line);
+        report_noreturn(1, "%-20s %10lu %10lu %12lu %12lu ", name,
+                        site->allocs, site->frees, site->bytes,
+                        site->peak_bytes);
+        for (int k = 0; k < LIFETIME_BUCKETS; k++)
+            if (site->lifetime[k])
+                report_noreturn(1, " <%lu: %lu", 1UL << k, site->lifetime[k]);
+        report(1, "");
+    }
 }
 
 /*
@@ -231,21 +873,21 @@ size_t allocation_check()
  */
 
 /*
- * Set/unset cautious mode.
- * In this mode, makes extra sure any block to be freed is currently allocated.
+ * Set/unset restricted allocation mode.
+ * In this mode, calls to malloc and free are disallowed.
  */
-void set_cautious_mode(bool cautious)
+void set_noallocate_mode(bool noallocate)
 {
-    cautious_mode = cautious;
+    noallocate_mode = noallocate;
 }
 
 /*
- * Set/unset restricted allocation mode.
- * In this mode, calls to malloc and free are disallowed.
+ * Set/unset no-malloc mode.
+ * In this mode, calls to malloc and realloc are disallowed, but not free.
  */
-void set_noallocate_mode(bool noallocate)
+void set_nomalloc_mode(bool nomalloc)
 {
-    noallocate_mode = noallocate;
+    nomalloc_mode = nomalloc;
 }
 
 /*
@@ -253,9 +895,7 @@ void set_noallocate_mode(bool noallocate)
  */
 bool error_check()
 {
-    bool e = error_occurred;
-    error_occurred = false;
-    return e;
+    return __atomic_exchange_n(&error_occurred, false, __ATOMIC_RELAXED);
 }
 
 /*
@@ -306,7 +946,7 @@ void exception_cancel()
  */
 void trigger_exception(char *msg)
 {
-    error_occurred = true;
+    set_error();
     error_message = msg;
     if (jmp_ready)
         siglongjmp(env, 1);
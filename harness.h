@@ -9,27 +9,100 @@
  * This test harness enables us to do stringent testing of code.
  * It overloads the library versions of malloc and free with ones that
  * allow checking for common allocation errors.
+ *
+ * The allocation functions may be called from several threads at once, and
+ * a block may be freed by another thread than the one which allocated it.
+ * Exception setups belong to the thread making them.  Threads other than
+ * the main one should block SIGALRM, so that the time limit interrupts the
+ * thread which set it up.
  */
 
 void *test_malloc(size_t size);
 void *test_calloc(size_t nmemb, size_t size);
 void test_free(void *p);
 char *test_strdup(const char *s);
-/* FIXME: provide test_realloc as well */
+/*
+ * Grow or shrink the block in place when malloc left room for it, else move
+ * it to a new block.  On failure, the block is left untouched.  Either way,
+ * a call counts as one allocation for fault injection.
+ */
+void *test_realloc(void *p, size_t size);
+
+/* Same as above, also recording the call site for allocation_profile() */
+void *test_malloc_at(size_t size, const char *file, int line);
+char *test_strdup_at(const char *s, const char *file, int line);
+void *test_realloc_at(void *p, size_t size, const char *file, int line);
+
+/*
+ * Draw from the fault injection schedule for an allocation of size bytes at
+ * line of file, as test_malloc_at() does, for code handing out memory it
+ * obtained earlier.  Return true if the allocation should fail.
+ */
+bool test_fail_at(size_t size, const char *file, int line);
 
 #ifdef INTERNAL
 
 /* Report number of allocated blocks */
 size_t allocation_check();
 
-/* Probability of malloc failing, expressed as percent */
+/*
+ * Report, for each call site, the number of allocations and frees, bytes
+ * allocated, peak bytes live and a histogram of block lifetimes.
+ * If reset, clear the statistics instead, so that the next report covers
+ * what happens from now on.
+ * Must not run while other threads allocate.
+ */
+void allocation_profile(bool reset);
+
+/*
+ * Fault injection schedule.  Allocations of at least fail_min_size bytes,
+ * ignored when 0, made at the call site set by fail_at_site(), if any,
+ * are eligible to fail.  Of these, every fail_every-th one fails,
+ * and any one fails with probability fail_probability percent plus
+ * fail_basis_points hundredths of a percent.  If neither is set, all
+ * eligible allocations fail.
+ */
 extern int fail_probability;
+extern int fail_basis_points;
+extern int fail_every;
+extern int fail_min_size;
+
+/*
+ * Only let allocations made at line of file fail, with file named as in
+ * allocation_profile().  A NULL file lets allocations anywhere fail.
+ * Return false, changing nothing, if could not allocate space.
+ */
+bool fail_at_site(const char *file, int line);
+
+/*
+ * Fast mode, for blocks allocated from now on.  When set, blocks are only
+ * counted, so that leaks still show, but get none of the checks, filling
+ * or per-site statistics, for performance runs.  Guard page mode takes
+ * precedence, so fast mode has no effect while it is on.  Fault injection
+ * still applies.
+ */
+extern int fast_mode;
+
+/*
+ * Guard page mode, for blocks allocated from now on.  When not off, each
+ * block is placed in its own mapping against an inaccessible page, after
+ * its payload to catch overruns or before its header to catch underruns,
+ * and accessing past the block faults at once.  This costs at least two
+ * pages and a few system calls per block.
+ */
+#define GUARD_OFF 0
+#define GUARD_AFTER 1
+#define GUARD_BEFORE 2
+extern int guard_pages;
+
+/* Seed of the pseudo-random failures, so that a run can be replayed */
+extern int fail_seed;
 
 /*
- * Set/unset cautious mode.
- * In this mode, makes extra sure any block to be freed is currently allocated.
+ * Start the schedule over from fail_seed, as if no allocation was made
+ * since.  Call after changing fail_seed or fail_every.
  */
-void set_cautious_mode(bool cautious);
+void fail_restart();
 
 /*
  * Set/unset restricted allocation mode.
@@ -37,6 +110,13 @@ void set_cautious_mode(bool cautious);
  */
 void set_noallocate_mode(bool noallocate);
 
+/*
+ * Set/unset no-malloc mode.
+ * In this mode, calls to malloc and realloc are disallowed, but not free,
+ * for operations which may only release memory.
+ */
+void set_nomalloc_mode(bool nomalloc);
+
 /*
   Return whether any errors have occurred since last time checked
  */
@@ -61,12 +141,13 @@ void trigger_exception(char *msg);
 #else /* !INTERNAL */
 
 /* Tested program use our versions of malloc and free */
-#define malloc test_malloc
+#define malloc(size) test_malloc_at(size, __FILE__, __LINE__)
 #define free test_free
+#define realloc(p, size) test_realloc_at(p, size, __FILE__, __LINE__)
 
 /* Use undef to avoid strdup redefined error */
 #undef strdup
-#define strdup test_strdup
+#define strdup(s) test_strdup_at(s, __FILE__, __LINE__)
 
 #endif
 
@@ -1,5 +1,9 @@
 // SPDX-License-Identifier: GPL-2.0
 #include "list_sort.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include "list.h"
 
@@ -96,7 +100,7 @@ static void merge_final(list_cmp_func_t cmp,
 }
 
 /**
- * list_sort - sort a list
+ * list_sort_bottom_up - sort a list
  * @priv: private data, opaque to list_sort(), passed to @cmp, disabled
  * @head: the list to sort
  * @cmp: the elements comparison function
@@ -179,7 +183,7 @@ static void merge_final(list_cmp_func_t cmp,
  * 2^(k+1) - 1 (second merge of case 5 when x == 2^(k-1) - 1).
  */
 
-void list_sort(struct list_head *head, list_cmp_func_t cmp)
+static void list_sort_bottom_up(struct list_head *head, list_cmp_func_t cmp)
 {
     struct list_head *list = head->next, *pending = NULL;
     size_t count = 0; /* Count of pending */
@@ -246,4 +250,438 @@ void list_sort(struct list_head *head, list_cmp_func_t cmp)
     }
     /* The final merge, rebuilding prev links */
     merge_final(cmp, head, pending, list);
-}
\ No newline at end of file
+}
+
+/*
+ * Adaptive path of list_sort(), for input made of long natural runs, such as
+ * sorted, reverse-sorted or nearly sorted lists. Runs are found in a single
+ * pass, descending ones reversed in place, and merged TimSort-style: a
+ * stack of runs is kept balanced so that merges stay within a constant
+ * factor of each other, and merges gallop once one side keeps winning.
+ * Sorted and reverse-sorted lists then take O(n) comparisons.
+ */
+
+/* Minimum average run length for the adaptive path to pay off */
+#define RUN_MIN_AVG 8
+
+/* Elements looked at before deciding the input has too many runs */
+#define RUN_PROBE 64
+
+/* Consecutive wins of one side after which a merge starts galloping */
+#define MIN_GALLOP 7
+
+/* Lengths of pending runs grow at least like Fibonacci numbers from the top
+ * of the stack down, so fewer than log_phi(2^64) < 93 are ever pending
+ */
+#define RUN_STACK 96
+
+struct run {
+    struct list_head *head, *tail; /* null-terminated, with prev links */
+    size_t len;
+};
+
+/*
+ * Find the natural run starting at @list, up to @limit elements long: a
+ * non-descending one, or a strictly descending one, whose strictness keeps
+ * equal elements from trading places once it is reversed.
+ * Describe it in @r and return the node following it. If @cut, the run is
+ * also cut off the list, and a descending one reversed, both links, on the
+ * way.
+ */
+static struct list_head *find_run(list_cmp_func_t cmp,
+                                  struct list_head *list,
+                                  size_t limit,
+                                  bool cut,
+                                  struct run *r)
+{
+    struct list_head *p = list, *next = p->next;
+    size_t len = 1;
+
+    if (next && limit > 1 && cmp(p, next) > 0) {
+        struct list_head *prev = NULL;
+        for (;;) {
+            if (cut) {
+                p->next = prev;
+                p->prev = next;
+            }
+            prev = p;
+            p = next;
+            next = p->next;
+            len++;
+            if (!next || len >= limit || cmp(p, next) <= 0)
+                break;
+        }
+        if (cut) {
+            p->next = prev;
+            r->head = p;
+            r->tail = list;
+        }
+    } else {
+        while (next && len < limit && cmp(p, next) <= 0) {
+            p = next;
+            next = p->next;
+            len++;
+        }
+        if (cut)
+            p->next = NULL;
+        r->head = list;
+        r->tail = p;
+    }
+
+    r->len = len;
+    return next;
+}
+
+/*
+ * Given that @x, the first node of its null-terminated list, sorts before
+ * the node @other of the other run (after it, if @left is false), return
+ * the last node from @x on which still does. Probes are spaced
+ * exponentially, so skipping k nodes takes O(log k) comparisons.
+ */
+static struct list_head *gallop(list_cmp_func_t cmp,
+                                struct list_head *x,
+                                struct list_head *other,
+                                bool left)
+{
+    struct list_head *good = x;
+
+    for (size_t step = 1; step;) {
+        struct list_head *p = good;
+        size_t i = 0;
+
+        for (; i < step && p->next; i++)
+            p = p->next;
+        if (i && (left ? cmp(p, other) <= 0 : cmp(other, p) > 0)) {
+            good = p;
+            step *= 2;
+        } else {
+            step /= 2;
+        }
+    }
+    return good;
+}
+
+/*
+ * Stably merge run @b, which follows run @a in the input, into @a.
+ * Prev links are kept up to date, which costs a store where the merge
+ * switches sides, and lets the merge look at the end of @b.
+ */
+static void merge_run(list_cmp_func_t cmp, struct run *a, const struct run *b)
+{
+    struct list_head dummy, *t = &dummy;
+    struct list_head *x = a->head, *y = b->head;
+    unsigned int wins_x = 0, wins_y = 0;
+
+    a->len += b->len;
+
+    /* Runs already in order, as in nearly sorted input */
+    if (cmp(a->tail, y) <= 0) {
+        a->tail->next = y;
+        y->prev = a->tail;
+        a->tail = b->tail;
+        return;
+    }
+
+    /* Runs in reverse order but for a few elements at the end of @b, as in
+     * reverse-sorted input whose descending runs were cut short by equal
+     * elements: what sorts strictly before @x goes first as a whole.
+     */
+    struct list_head *z = b->tail;
+    for (int i = 1; cmp(x, z) <= 0; i++) {
+        if (z == y || i == MIN_GALLOP) {
+            z = NULL;
+            break;
+        }
+        z = z->prev;
+    }
+    if (z) {
+        t->next = y;
+        y->prev = t;
+        t = z;
+        y = z->next;
+        if (!y) {
+            t->next = x;
+            x->prev = t;
+            a->head = dummy.next;
+            return;
+        }
+    }
+
+    for (;;) {
+        /* if equal, take 'x' -- important for sort stability */
+        if (cmp(x, y) <= 0) {
+            struct list_head *last = x;
+            if (++wins_x >= MIN_GALLOP)
+                last = gallop(cmp, x, y, true);
+            wins_y = 0;
+            t->next = x;
+            x->prev = t;
+            t = last;
+            x = last->next;
+            if (!x) {
+                t->next = y;
+                y->prev = t;
+                a->tail = b->tail;
+                break;
+            }
+        } else {
+            struct list_head *last = y;
+            if (++wins_y >= MIN_GALLOP)
+                last = gallop(cmp, y, x, false);
+            wins_x = 0;
+            t->next = y;
+            y->prev = t;
+            t = last;
+            y = last->next;
+            if (!y) {
+                t->next = x;
+                x->prev = t;
+                break;
+            }
+        }
+    }
+    a->head = dummy.next;
+}
+
+/* Merge runs k and k + 1 of the stack of @n runs */
+static void merge_at(list_cmp_func_t cmp, struct run *stack, size_t n, size_t k)
+{
+    merge_run(cmp, &stack[k], &stack[k + 1]);
+    if (k + 2 < n)
+        stack[k + 1] = stack[k + 2];
+}
+
+/* Merge all the @n runs of @stack into stack[0] */
+static void merge_all(list_cmp_func_t cmp, struct run *stack, size_t n)
+{
+    while (n > 1) {
+        size_t k = n - 2;
+        if (k > 0 && stack[k - 1].len < stack[k + 1].len)
+            k--;
+        merge_at(cmp, stack, n--, k);
+    }
+}
+
+/*
+ * Sort @head through its natural runs if they are long enough on average.
+ * Return false, leaving the list untouched, if the first RUN_PROBE elements
+ * show they are not. Should runs get too short later on, the rest of the
+ * list is handed to list_sort_bottom_up() and merged with the sorted front.
+ */
+static bool list_sort_runs(struct list_head *head, list_cmp_func_t cmp)
+{
+    struct run stack[RUN_STACK];
+    struct list_head *list = head->next;
+    size_t n = 0, seen = 0, nruns = 0;
+
+    /* Random input has runs of two elements or so, and is told apart here
+     * at the cost of RUN_PROBE comparisons
+     */
+    head->prev->next = NULL;
+    for (struct list_head *p = list; p && seen < RUN_PROBE; nruns++) {
+        p = find_run(cmp, p, RUN_PROBE - seen, false, &stack[0]);
+        seen += stack[0].len;
+    }
+    if (nruns * RUN_MIN_AVG > seen) {
+        head->prev->next = head;
+        return false;
+    }
+
+    seen = nruns = 0;
+    while (list) {
+        if (seen >= RUN_PROBE && nruns * RUN_MIN_AVG > seen)
+            break;
+
+        list = find_run(cmp, list, SIZE_MAX, true, &stack[n]);
+        seen += stack[n++].len;
+        nruns++;
+
+        /* Restore the invariants which keep merges balanced */
+        while (n > 1) {
+            size_t k = n - 2;
+            struct run *s = stack;
+            if ((k > 0 && s[k - 1].len <= s[k].len + s[k + 1].len) ||
+                (k > 1 && s[k - 2].len <= s[k - 1].len + s[k].len)) {
+                if (s[k - 1].len < s[k + 1].len)
+                    k--;
+            } else if (s[k].len > s[k + 1].len) {
+                break;
+            }
+            merge_at(cmp, stack, n--, k);
+        }
+    }
+
+    merge_all(cmp, stack, n);
+
+    if (list) {
+        /* Runs got short: sort the rest the usual way, then merge */
+        struct list_head rest = {.next = list, .prev = head->prev};
+        head->prev->next = &rest;
+        list_sort_bottom_up(&rest, cmp);
+        rest.prev->next = NULL;
+        merge_final(cmp, head, stack[0].head, rest.next);
+        return true;
+    }
+
+    /* Runs keep their prev links, only the ends need linking to head */
+    head->next = stack[0].head;
+    stack[0].head->prev = head;
+    stack[0].tail->next = head;
+    head->prev = stack[0].tail;
+    return true;
+}
+
+/**
+ * list_sort - sort a list
+ * @head: the list to sort
+ * @cmp: the elements comparison function, see list_sort_bottom_up()
+ *
+ * Input made of long natural runs, such as sorted or nearly sorted lists,
+ * is sorted by merging its runs. Anything else goes through the bottom-up
+ * merge sort of the Linux kernel.
+ */
+void list_sort(struct list_head *head, list_cmp_func_t cmp)
+{
+    if (head->next == head->prev) /* Zero or one elements */
+        return;
+
+    if (!list_sort_runs(head, cmp))
+        list_sort_bottom_up(head, cmp);
+}
+
+/* Runs shorter than this are not worth a thread of their own */
+#define PARALLEL_MIN_RUN 4096
+
+/*
+ * Work item of list_sort_parallel(): either a run to sort, which is then
+ * left in @a as a null-terminated list, or the two null-terminated runs @a
+ * and @b to merge into @a.
+ */
+struct sort_job {
+    list_cmp_func_t cmp;
+    struct list_head head;
+    struct list_head *a, *b;
+    pthread_t tid;
+    int started;
+};
+
+static void *sort_run(void *arg)
+{
+    struct sort_job *job = arg;
+
+    list_sort(&job->head, job->cmp);
+    job->a = job->head.next;
+    job->head.prev->next = NULL;
+    return NULL;
+}
+
+static void *merge_runs(void *arg)
+{
+    struct sort_job *job = arg;
+
+    job->a = merge(job->cmp, job->a, job->b);
+    return NULL;
+}
+
+/*
+ * Run fn on every job of @jobs, @njobs of them spaced @stride apart, one
+ * thread each, the first one on the calling thread. A job whose thread
+ * cannot be created runs on the calling thread as well.
+ */
+static void run_jobs(struct sort_job *jobs,
+                     int njobs,
+                     int stride,
+                     void *(*fn)(void *))
+{
+    for (int i = 1; i < njobs; i++) {
+        struct sort_job *job = &jobs[i * stride];
+        job->started = !pthread_create(&job->tid, NULL, fn, job);
+    }
+
+    fn(&jobs[0]);
+    for (int i = 1; i < njobs; i++) {
+        struct sort_job *job = &jobs[i * stride];
+        if (job->started)
+            pthread_join(job->tid, NULL);
+        else
+            fn(job);
+    }
+}
+
+/**
+ * list_sort_parallel - sort a list using several threads
+ * @head: the list to sort
+ * @cmp: the elements comparison function, see list_sort()
+ * @nthreads: number of threads to use, including the calling one
+ *
+ * The list is cut into @nthreads runs of about the same length, which are
+ * sorted concurrently by list_sort(). Sorted runs are then merged pairwise
+ * along a binary tree, the merges of a level running concurrently, and the
+ * last merge rebuilding the prev links. The sort is stable, as runs are
+ * only ever merged with their right neighbour. @cmp is called from several
+ * threads at once, so it must not modify shared state.
+ *
+ * Lists too short to give every thread PARALLEL_MIN_RUN elements are
+ * sorted by list_sort() alone.
+ *
+ * SIGALRM is blocked while the threads run, so that the time limit handler
+ * cannot longjmp() out of the sort and leave the list half linked; an alarm
+ * which went off in the meantime is delivered once the list is whole again.
+ * Other signals, such as SIGSEGV, are left alone for their handlers to
+ * report. Callers with more to bring up to date after the sort should keep
+ * SIGALRM blocked until they are done.
+ */
+void list_sort_parallel(struct list_head *head,
+                        list_cmp_func_t cmp,
+                        int nthreads)
+{
+    struct sort_job jobs[LIST_SORT_MAX_THREADS];
+    struct list_head *node;
+    size_t n = 0;
+
+    list_for_each (node, head)
+        n++;
+
+    if (nthreads > LIST_SORT_MAX_THREADS)
+        nthreads = LIST_SORT_MAX_THREADS;
+    if (nthreads < 2 || n < (size_t) nthreads * PARALLEL_MIN_RUN) {
+        list_sort(head, cmp);
+        return;
+    }
+
+    /* Cut the list into runs, the first n % nthreads of them one longer */
+    node = head->next;
+    for (int i = 0; i < nthreads; i++) {
+        struct sort_job *job = &jobs[i];
+        size_t len = n / nthreads + ((size_t) i < n % nthreads);
+
+        job->cmp = cmp;
+        job->head.next = node;
+        node->prev = &job->head;
+        while (--len)
+            node = node->next;
+        job->head.prev = node;
+        node = node->next;
+        job->head.prev->next = &job->head;
+    }
+
+    sigset_t alarm, old;
+    sigemptyset(&alarm);
+    sigaddset(&alarm, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &alarm, &old);
+
+    run_jobs(jobs, nthreads, 1, sort_run);
+
+    int stride = 1;
+    for (; 2 * stride < nthreads; stride *= 2) {
+        int npairs = 0;
+        for (int i = 0; i + stride < nthreads; i += 2 * stride) {
+            jobs[i].b = jobs[i + stride].a;
+            npairs++;
+        }
+        run_jobs(jobs, npairs, 2 * stride, merge_runs);
+    }
+    merge_final(cmp, head, jobs[0].a, jobs[stride].a);
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
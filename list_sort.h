@@ -11,4 +11,11 @@ typedef int (*list_cmp_func_t)(const struct list_head *,
                                const struct list_head *);
 
 void list_sort(struct list_head *head, list_cmp_func_t cmp);
+
+/* Upper bound on the number of threads used by list_sort_parallel() */
+#define LIST_SORT_MAX_THREADS 64
+
+void list_sort_parallel(struct list_head *head,
+                        list_cmp_func_t cmp,
+                        int nthreads);
 #endif
\ No newline at end of file
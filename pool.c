@@ -0,0 +1,102 @@
+#include <stdlib.h>
+
+#include "harness.h"
+#include "pool.h"
+
+/* Header at the beginning of every slab, padded to keep objects aligned */
+struct slab {
+    struct slab *next;
+    size_t nobjs;
+};
+
+void pool_init(pool_t *p, size_t obj_size)
+{
+    p->obj_size = (obj_size + 15) & ~(size_t) 15;
+    p->slab_objs = POOL_MIN_SLAB_OBJS;
+    p->free_list = NULL;
+    p->cursor = NULL;
+    p->limit = NULL;
+    p->slabs = NULL;
+}
+
+/* Add a slab of at least nobjs objects to the pool and make it the bump
+ * region
+ */
+static bool pool_grow(pool_t *p, size_t nobjs)
+{
+    if (nobjs < p->slab_objs)
+        nobjs = p->slab_objs;
+
+    struct slab *s = malloc(sizeof(struct slab) + nobjs * p->obj_size);
+    if (!s)
+        return false;
+
+    s->nobjs = nobjs;
+    s->next = p->slabs;
+    p->slabs = s;
+
+    p->cursor = (char *) (s + 1);
+    p->limit = p->cursor + s->nobjs * p->obj_size;
+
+    if (p->slab_objs < POOL_MAX_SLAB_OBJS)
+        p->slab_objs <<= 1;
+
+    return true;
+}
+
+bool pool_reserve(pool_t *p)
+{
+    if (p->free_list || p->cursor != p->limit)
+        return true;
+    return pool_grow(p, 0);
+}
+
+bool pool_reserve_n(pool_t *p, size_t n)
+{
+    size_t left = (p->limit - p->cursor) / p->obj_size;
+    if (left >= n)
+        return true;
+
+    /* Hand out what is left of the newest slab first */
+    for (; p->cursor != p->limit; p->cursor += p->obj_size)
+        pool_free(p, p->cursor);
+    return pool_grow(p, n);
+}
+
+void *pool_alloc(pool_t *p)
+{
+    /* Taking an object is an allocation as far as fault injection goes */
+    if (test_fail_at(p->obj_size, __FILE__, __LINE__))
+        return NULL;
+
+    void *obj = p->free_list;
+    if (obj) {
+        p->free_list = *(void **) obj;
+        return obj;
+    }
+
+    if (p->cursor == p->limit && !pool_grow(p, 0))
+        return NULL;
+
+    obj = p->cursor;
+    p->cursor += p->obj_size;
+    return obj;
+}
+
+void pool_free(pool_t *p, void *obj)
+{
+    *(void **) obj = p->free_list;
+    p->free_list = obj;
+}
+
+void pool_destroy(pool_t *p)
+{
+    struct slab *s = p->slabs;
+    while (s) {
+        struct slab *next = s->next;
+        free(s);
+        s = next;
+    }
+
+    pool_init(p, p->obj_size);
+}
@@ -0,0 +1,71 @@
+#ifndef LAB0_POOL_H
+#define LAB0_POOL_H
+
+/*
+ * Fixed-size object pool.
+ *
+ * Objects are carved out of slabs obtained from malloc. Released objects go
+ * onto a free list and are handed out again before the pool grows, so
+ * allocation and release cost O(1) and never reach the underlying allocator
+ * except to add a slab. Each new slab holds twice as many objects as the
+ * previous one (up to POOL_MAX_SLAB_OBJS), hence a pool holding n objects
+ * owns only O(log n + n / POOL_MAX_SLAB_OBJS) slabs, all of which are given
+ * back at once by pool_destroy().
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Objects in the first slab of a pool */
+#define POOL_MIN_SLAB_OBJS 32
+
+/* Upper bound of objects in a single slab */
+#define POOL_MAX_SLAB_OBJS 4096
+
+struct slab;
+
+typedef struct pool {
+    size_t obj_size;    /* Size of each object, multiple of 16 */
+    size_t slab_objs;   /* Number of objects in the next slab */
+    void *free_list;    /* Released objects, linked through first word */
+    char *cursor;       /* Next never-used object in the newest slab */
+    char *limit;        /* End of the newest slab */
+    struct slab *slabs; /* All slabs owned by the pool */
+} pool_t;
+
+/*
+ * Initialize an empty pool handing out objects of obj_size bytes.
+ * No memory is allocated until the first pool_alloc() or pool_reserve().
+ */
+void pool_init(pool_t *p, size_t obj_size);
+
+/*
+ * Make sure the next pool_alloc() does not need to add a slab.
+ * Return false if could not allocate space.
+ */
+bool pool_reserve(pool_t *p);
+
+/*
+ * Make sure the next n calls to pool_alloc() do not need to add a slab,
+ * adding now one large enough for all of them if need be.
+ * Return false if could not allocate space.
+ */
+bool pool_reserve_n(pool_t *p, size_t n);
+
+/*
+ * Get an object from the pool.
+ * Return NULL if could not allocate space, or if the test harness injects a
+ * failure, which may happen even when a slab is reserved.
+ */
+void *pool_alloc(pool_t *p);
+
+/* Give an object obtained from pool_alloc() back to pool p */
+void pool_free(pool_t *p, void *obj);
+
+/*
+ * Release all slabs of the pool, including objects still handed out,
+ * and leave it empty.
+ */
+void pool_destroy(pool_t *p);
+
+#endif /* LAB0_POOL_H */
@@ -45,7 +45,6 @@
 /*
  * How large is a queue before it's considered big.
  * This affects how it gets printed
- * and whether cautious mode is used when freeing the queue
  */
 #define BIG_LIST 30
 static int big_list_size = BIG_LIST;
@@ -71,6 +70,26 @@ static int fail_count = 0;
 
 static int string_length = MAXSTRING;
 
+/* Number of threads sorting the queue in lsort */
+static int sort_threads = 1;
+
+/* Whether new queues share one copy of equal strings */
+static int intern_mode = 0;
+
+/* Whether the current queue shares one copy of equal strings */
+static inline bool queue_interned()
+{
+    return l_meta.l && queue_of(l_meta.l)->intern;
+}
+
+/*
+ * Block resized by the realloc command through the test allocator, which
+ * fills it with the letters of charset in turn to check that its contents
+ * survive.  It is not part of the queue, so leak checks leave it out.
+ */
+static char *scratch = NULL;
+static int scratch_size = 0;
+
 #define MIN_RANDSTR_LEN 5
 #define MAX_RANDSTR_LEN 10
 static const char charset[] = "abcdefghijklmnopqrstuvwxyz";
@@ -90,19 +109,16 @@ static bool do_free(int argc, char *argv[])
         report(3, "Warning: Calling free on null queue");
     error_check();
 
-    if (lcnt > big_list_size)
-        set_cautious_mode(false);
     if (exception_setup(true))
         q_free(l_meta.l);
     exception_cancel();
-    set_cautious_mode(true);
 
     l_meta.size = 0;
     l_meta.l = NULL;
     lcnt = 0;
     show_queue(3);
 
-    size_t bcnt = allocation_check();
+    size_t bcnt = allocation_check() - (scratch ? 1 : 0);
     if (bcnt > 0) {
         report(1, "ERROR: Freed queue, but %lu blocks are still allocated",
                bcnt);
@@ -129,6 +145,8 @@ static bool do_new(int argc, char *argv[])
     if (exception_setup(true)) {
         l_meta.l = q_new();
         l_meta.size = 0;
+        if (l_meta.l && intern_mode)
+            q_set_intern(l_meta.l, true);
     }
     exception_cancel();
     lcnt = 0;
@@ -153,6 +171,71 @@ static void fill_rand_string(char *buf, size_t buf_size)
     buf[len] = '\0';
 }
 
+/* Strings inserted per call of q_insert_head_bulk() or q_insert_tail_bulk() */
+#define BULK_BATCH 4096
+
+/*
+ * Insert reps copies of string inserts, or random strings if need_rand, at
+ * head or tail of the queue, a batch at a time through the bulk API.
+ * Return the number of elements inserted, less than reps if a batch could
+ * not be inserted, in which case the caller goes on one element at a time.
+ * Set *ok to false if the strings are not copied properly.
+ */
+static int insert_bulk(bool tail, char *inserts, bool need_rand, int reps,
+                       bool *ok)
+{
+    static char rand_bufs[BULK_BATCH][MAX_RANDSTR_LEN];
+    static char *strs[BULK_BATCH];
+    int done = 0;
+
+    while (done < reps) {
+        int n = reps - done < BULK_BATCH ? reps - done : BULK_BATCH;
+        for (int i = 0; i < n; i++) {
+            strs[i] = inserts;
+            if (need_rand) {
+                fill_rand_string(rand_bufs[i], sizeof(rand_bufs[i]));
+                strs[i] = rand_bufs[i];
+            }
+        }
+
+        bool rval = tail ? q_insert_tail_bulk(l_meta.l, strs, n)
+                         : q_insert_head_bulk(l_meta.l, strs, n);
+        if (!rval)
+            break;
+        done += n;
+        lcnt += n;
+        l_meta.size += n;
+        if (error_check()) {
+            *ok = false;
+            break;
+        }
+
+        /* Check the last string inserted against its neighbor */
+        struct list_head *last = tail ? l_meta.l->prev : l_meta.l->next;
+        struct list_head *prev = tail ? last->prev : last->next;
+        char *cur_inserts = list_entry(last, element_t, list)->value;
+        if (!cur_inserts) {
+            report(1, "ERROR: Failed to save copy of string in queue");
+            *ok = false;
+        } else if (cur_inserts == strs[n - 1]) {
+            report(1,
+                   "ERROR: Need to allocate and copy string for new queue "
+                   "element");
+            *ok = false;
+        } else if (n > 1 && !queue_interned() &&
+                   cur_inserts == list_entry(prev, element_t, list)->value) {
+            report(1,
+                   "ERROR: Need to allocate separate string for each queue "
+                   "element");
+            *ok = false;
+        }
+        if (!*ok)
+            break;
+    }
+
+    return done;
+}
+
 /* insert head */
 static bool do_ih(int argc, char *argv[])
 {
@@ -197,7 +280,9 @@ static bool do_ih(int argc, char *argv[])
     error_check();
 
     if (exception_setup(true)) {
-        for (int r = 0; ok && r < reps; r++) {
+        int r = reps > 1 ? insert_bulk(false, inserts, need_rand, reps, &ok)
+                         : 0;
+        for (; ok && r < reps; r++) {
             if (need_rand)
                 fill_rand_string(randstr_buf, sizeof(randstr_buf));
             bool rval = q_insert_head(l_meta.l, inserts);
@@ -215,7 +300,8 @@ static bool do_ih(int argc, char *argv[])
                            "queue element");
                     ok = false;
                     break;
-                } else if (r == 1 && lasts == cur_inserts) {
+                } else if (r == 1 && lasts == cur_inserts &&
+                           !queue_interned()) {
                     report(1,
                            "ERROR: Need to allocate separate string for each "
                            "queue element");
@@ -286,7 +372,9 @@ static bool do_it(int argc, char *argv[])
     error_check();
 
     if (exception_setup(true)) {
-        for (int r = 0; ok && r < reps; r++) {
+        int r = reps > 1 ? insert_bulk(true, inserts, need_rand, reps, &ok)
+                         : 0;
+        for (; ok && r < reps; r++) {
             if (need_rand)
                 fill_rand_string(randstr_buf, sizeof(randstr_buf));
             bool rval = q_insert_tail(l_meta.l, inserts);
@@ -318,6 +406,79 @@ static bool do_it(int argc, char *argv[])
     return ok;
 }
 
+/* Tell whether the queue is in the order of q_cmp() */
+static bool queue_in_order()
+{
+    struct list_head *cur;
+
+    for (cur = l_meta.l->next; cur != l_meta.l && cur->next != l_meta.l;
+         cur = cur->next) {
+        if (q_cmp(list_entry(cur, element_t, list),
+                  list_entry(cur->next, element_t, list)) > 0)
+            return false;
+    }
+    return true;
+}
+
+static bool do_is(int argc, char *argv[])
+{
+    char randstr_buf[MAX_RANDSTR_LEN];
+    int reps = 1;
+    bool ok = true, need_rand = false;
+    if (argc != 2 && argc != 3) {
+        report(1, "%s needs 1-2 arguments", argv[0]);
+        return false;
+    }
+
+    char *inserts = argv[1];
+    if (argc == 3) {
+        if (!get_int(argv[2], &reps)) {
+            report(1, "Invalid number of insertions '%s'", argv[2]);
+            return false;
+        }
+    }
+
+    if (!strcmp(inserts, "RAND")) {
+        need_rand = true;
+        inserts = randstr_buf;
+    }
+
+    if (!l_meta.l)
+        report(3, "Warning: Calling insert sorted on null queue");
+    error_check();
+
+    if (exception_setup(true)) {
+        for (int r = 0; ok && r < reps; r++) {
+            if (need_rand)
+                fill_rand_string(randstr_buf, sizeof(randstr_buf));
+            if (q_insert_sorted(l_meta.l, inserts)) {
+                lcnt++;
+                l_meta.size++;
+            } else {
+                fail_count++;
+                if (fail_count < fail_limit)
+                    report(2, "Insertion of %s failed", inserts);
+                else {
+                    report(1,
+                           "ERROR: Insertion of %s failed (%d failures total)",
+                           inserts, fail_count);
+                    ok = false;
+                }
+            }
+            ok = ok && !error_check();
+        }
+    }
+    exception_cancel();
+
+    if (ok && l_meta.l && !queue_in_order()) {
+        report(1, "ERROR: Not sorted in ascending order");
+        ok = false;
+    }
+
+    show_queue(3);
+    return ok && !error_check();
+}
+
 static bool do_remove(int option, int argc, char *argv[])
 {
     // option 0 is for remove head; option 1 is for remove tail
@@ -488,6 +649,76 @@ static bool do_rhq(int argc, char *argv[])
     return ok && !error_check();
 }
 
+/*
+ * Gather the elements of the queue, in order, into an array whose length is
+ * stored in *n, walking the list rather than trusting any count.
+ * Return NULL, having reported it, if the array could not be allocated.
+ */
+static element_t **queue_elements(size_t *n)
+{
+    struct list_head *cur;
+    size_t cnt = 0;
+
+    if (l_meta.l) {
+        list_for_each (cur, l_meta.l)
+            cnt++;
+    }
+
+    element_t **els = malloc(sizeof(element_t *) * (cnt + 1));
+    if (!els) {
+        report(1,
+               "INTERNAL ERROR.  Could not allocate space for queue elements");
+        return NULL;
+    }
+
+    *n = 0;
+    if (l_meta.l) {
+        list_for_each (cur, l_meta.l)
+            els[(*n)++] = list_entry(cur, element_t, list);
+    }
+    return els;
+}
+
+/*
+ * Check that the queue holds the n elements of expect, in this order and
+ * nothing else, and that q_size() agrees. The walk gives up after n + 1
+ * nodes, in case the links were left in a loop.
+ */
+static bool check_elements(element_t **expect, size_t n)
+{
+    struct list_head *cur = l_meta.l->next;
+    size_t i;
+
+    lcnt = n;
+    l_meta.size = n;
+
+    for (i = 0; i < n && cur != l_meta.l; i++, cur = cur->next) {
+        if (list_entry(cur, element_t, list) != expect[i]) {
+            report(1, "ERROR: Wrong element at index %zu of queue", i);
+            return false;
+        }
+    }
+    if (i < n) {
+        report(1, "ERROR: Queue holds %zu elements, but should hold %zu", i,
+               n);
+        return false;
+    }
+    if (cur != l_meta.l) {
+        report(1, "ERROR: Queue holds more than the %zu expected elements", n);
+        return false;
+    }
+
+    int cnt = q_size(l_meta.l);
+    if (cnt < 0 || (size_t) cnt != n) {
+        report(1,
+               "ERROR: Computed queue size as %d, but queue holds %zu "
+               "elements",
+               cnt, n);
+        return false;
+    }
+    return true;
+}
+
 static bool do_dedup(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -495,35 +726,39 @@ static bool do_dedup(int argc, char *argv[])
         return false;
     }
 
+    /* Only the elements whose string differs from both neighbors remain */
+    size_t n, m = 0;
+    element_t **expect = queue_elements(&n);
+    if (!expect)
+        return false;
+
+    element_t *prev = NULL;
+    for (size_t i = 0; i < n; i++) {
+        element_t *el = expect[i];
+        bool dup = (prev && !strcmp(prev->value, el->value)) ||
+                   (i + 1 < n && !strcmp(el->value, expect[i + 1]->value));
+        prev = el;
+        if (!dup)
+            expect[m++] = el;
+    }
+
     bool ok = true;
-    // set_noallocate_mode(true);
+    /* Deleting duplicates frees what it removes, but must allocate nothing */
+    set_nomalloc_mode(true);
     if (exception_setup(true))
         ok = q_delete_dup(l_meta.l);
     exception_cancel();
 
-    // set_noallocate_mode(false);
+    set_nomalloc_mode(false);
 
     if (!ok) {
         report(1, "ERROR: Calling delete duplicate on null queue");
+        free(expect);
         return false;
     }
 
-    element_t *item = NULL;
-    if (l_meta.size) {
-        list_for_each_entry (item, l_meta.l, list) {
-            element_t *next_item;
-            if (item->list.next == l_meta.l)
-                break;
-            next_item = list_entry(item->list.next, element_t, list);
-
-            // assume queue has been sorted
-            if (strcmp(item->value, next_item->value) == 0) {
-                report(1, "ERROR: Contain duplicate string on queue");
-                ok = false;
-                break;
-            }
-        }
-    }
+    ok = check_elements(expect, m);
+    free(expect);
     show_queue(3);
 
     return ok && !error_check();
@@ -599,7 +834,31 @@ static bool do_size(int argc, char *argv[])
     return ok && !error_check();
 }
 
-bool do_sort(int argc, char *argv[])
+/* Check that the cnt elements of the queue are in ascending order */
+static bool check_order(int cnt)
+{
+    if (!l_meta.size)
+        return true;
+
+    for (struct list_head *cur_l = l_meta.l->next; cur_l != l_meta.l && --cnt;
+         cur_l = cur_l->next) {
+        /* Ensure each element in ascending order */
+        /* FIXME: add an option to specify sorting order */
+        element_t *item, *next_item;
+        item = list_entry(cur_l, element_t, list);
+        next_item = list_entry(cur_l->next, element_t, list);
+        if (strcasecmp(item->value, next_item->value) > 0) {
+            report(1, "ERROR: Not sorted in ascending order");
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Run a sort command, which sorts the queue with sort */
+static bool sort_and_check(int argc,
+                           char *argv[],
+                           void (*sort)(struct list_head *))
 {
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
@@ -615,33 +874,28 @@ bool do_sort(int argc, char *argv[])
         report(3, "Warning: Calling sort on single node");
     error_check();
 
-    set_noallocate_mode(true);
+    /* Sorting may use scratch space, but must give it all back */
+    size_t bcnt = allocation_check();
     if (exception_setup(true))
-        q_sort(l_meta.l);
+        sort(l_meta.l);
     exception_cancel();
-    set_noallocate_mode(false);
 
     bool ok = true;
-    if (l_meta.size) {
-        for (struct list_head *cur_l = l_meta.l->next;
-             cur_l != l_meta.l && --cnt; cur_l = cur_l->next) {
-            /* Ensure each element in ascending order */
-            /* FIXME: add an option to specify sorting order */
-            element_t *item, *next_item;
-            item = list_entry(cur_l, element_t, list);
-            next_item = list_entry(cur_l->next, element_t, list);
-            if (strcasecmp(item->value, next_item->value) > 0) {
-                report(1, "ERROR: Not sorted in ascending order");
-                ok = false;
-                break;
-            }
-        }
+    if (allocation_check() != bcnt) {
+        report(1, "ERROR: Sorting changed the number of allocated blocks");
+        ok = false;
     }
+    ok = check_order(cnt) && ok;
 
     show_queue(3);
     return ok && !error_check();
 }
 
+bool do_sort(int argc, char *argv[])
+{
+    return sort_and_check(argc, argv, q_sort);
+}
+
 static bool do_dm(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -658,7 +912,329 @@ static bool do_dm(int argc, char *argv[])
         ok = q_delete_mid(l_meta.l);
     exception_cancel();
 
+    if (ok) {
+        lcnt--;
+        l_meta.size--;
+    }
+
+    show_queue(3);
+    return ok && !error_check();
+}
+
+/* Parse the index argument of get and delat */
+static bool get_index(char *arg, size_t *index)
+{
+    int i;
+
+    if (!get_int(arg, &i) || i < 0) {
+        report(1, "Invalid index '%s'", arg);
+        return false;
+    }
+    *index = i;
+    return true;
+}
+
+static bool do_get(int argc, char *argv[])
+{
+    size_t i;
+
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+    if (!get_index(argv[1], &i))
+        return false;
+
+    if (!l_meta.l)
+        report(3, "Warning: Calling get on null queue");
+    error_check();
+
+    element_t *el = NULL;
+    if (exception_setup(true))
+        el = q_get(l_meta.l, i);
+    exception_cancel();
+
+    /* Check against a walk of the list */
+    element_t *expect = NULL, *item;
+    if (l_meta.l) {
+        size_t n = 0;
+        list_for_each_entry (item, l_meta.l, list) {
+            if (n++ == i) {
+                expect = item;
+                break;
+            }
+        }
+    }
+
+    bool ok = el == expect;
+    if (!ok)
+        report(1, "ERROR: Got wrong element at index %zu", i);
+    else if (el)
+        report(2, "Element %zu = %s", i, el->value);
+    else
+        report(2, "No element at index %zu", i);
+
+    return ok && !error_check();
+}
+
+static bool do_delat(int argc, char *argv[])
+{
+    size_t i;
+
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+    if (!get_index(argv[1], &i))
+        return false;
+
+    if (!l_meta.l)
+        report(3, "Warning: Try to access null queue");
+    error_check();
+
+    /* Only the element at index i is to go, if there is one */
+    size_t n;
+    element_t **expect = queue_elements(&n);
+    if (!expect)
+        return false;
+    char *target = i < n ? strdup(expect[i]->value) : NULL;
+    if (i < n && !target) {
+        report(1, "INTERNAL ERROR.  Could not allocate space for string");
+        free(expect);
+        return false;
+    }
+
+    bool ok = false;
+    if (exception_setup(true))
+        ok = q_delete_at(l_meta.l, i);
+    exception_cancel();
+
+    if (ok != (i < n)) {
+        if (ok)
+            report(1, "ERROR: Deleted element at index %zu past the end", i);
+        else
+            report(1, "ERROR: Failed to delete element at index %zu", i);
+        free(expect);
+        free(target);
+        return false;
+    }
+
+    bool deleted = ok;
+    if (deleted) {
+        memmove(&expect[i], &expect[i + 1], sizeof(element_t *) * (n - i - 1));
+        n--;
+    }
+    ok = !l_meta.l || check_elements(expect, n);
+    if (ok && deleted)
+        report(2, "Deleted %s at index %zu", target, i);
+    else if (ok)
+        report(2, "No element at index %zu", i);
+    free(expect);
+    free(target);
+
+    show_queue(3);
+    return ok && !error_check();
+}
+
+static bool do_find(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+
+    if (!l_meta.l)
+        report(3, "Warning: Calling find on null queue");
+    error_check();
+
+    element_t *el = NULL;
+    if (exception_setup(true))
+        el = q_find(l_meta.l, argv[1]);
+    exception_cancel();
+
+    /* Check against a walk of the list */
+    element_t *expect = NULL, *item;
+    if (l_meta.l) {
+        list_for_each_entry (item, l_meta.l, list) {
+            if (!strcmp(item->value, argv[1])) {
+                expect = item;
+                break;
+            }
+        }
+    }
+
+    bool ok = el == expect;
+    if (!ok)
+        report(1, "ERROR: Found wrong element for %s", argv[1]);
+    else if (el)
+        report(2, "Found %s", argv[1]);
+    else
+        report(2, "%s not found", argv[1]);
+
+    return ok && !error_check();
+}
+
+static bool do_range(int argc, char *argv[])
+{
+    if (argc != 3) {
+        report(1, "%s needs 2 arguments", argv[0]);
+        return false;
+    }
+
+    char *lo = argv[1], *hi = argv[2];
+    if (!l_meta.l)
+        report(3, "Warning: Try to access null queue");
+    error_check();
+
+    LIST_HEAD(out);
+    size_t k = 0;
+    if (exception_setup(true))
+        k = q_extract_range(l_meta.l, lo, hi, &out);
+    exception_cancel();
+
+    lcnt -= k;
+    l_meta.size -= k;
+
+    /* Extracted elements and only them fall in the range */
+    bool ok = true;
+    element_t *item, *safe;
+    size_t n = 0;
+    list_for_each_entry_safe (item, safe, &out, list) {
+        if (strcmp(item->value, lo) < 0 || strcmp(item->value, hi) > 0) {
+            report(1, "ERROR: Extracted %s, out of range", item->value);
+            ok = false;
+        }
+        n++;
+        q_release_element(item);
+    }
+    if (n != k) {
+        report(1, "ERROR: Extracted %zu elements, but counted %zu", k, n);
+        ok = false;
+    }
+    if (l_meta.l) {
+        list_for_each_entry (item, l_meta.l, list) {
+            if (strcmp(item->value, lo) >= 0 && strcmp(item->value, hi) <= 0) {
+                report(1, "ERROR: Left %s in queue", item->value);
+                ok = false;
+                break;
+            }
+        }
+    }
+    if (ok)
+        report(2, "Extracted %zu elements", k);
+
+    show_queue(3);
+    return ok && !error_check();
+}
+
+/* Element of the queue along with its position, to sort by string */
+struct ranked {
+    element_t *el;
+    size_t pos;
+};
+
+static int cmp_ranked(const void *a, const void *b)
+{
+    const struct ranked *x = a, *y = b;
+    int c = strcmp(x->el->value, y->el->value);
+    if (c)
+        return c;
+    return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+static bool do_udedup(int argc, char *argv[])
+{
+    bool keep_first = argc == 2 && !strcmp(argv[1], "first");
+
+    if (argc > 2 || (argc == 2 && !keep_first)) {
+        report(1, "%s takes no arguments but first", argv[0]);
+        return false;
+    }
+
+    if (!l_meta.l)
+        report(3, "Warning: Try to access null queue");
+    error_check();
+
+    /*
+     * Work out the survivors beforehand: the first element holding each
+     * string if keep_first, else only the elements whose string is unique.
+     */
+    size_t n, m = 0;
+    element_t **els = queue_elements(&n);
+    if (!els)
+        return false;
+
+    struct ranked *ranks = malloc(sizeof(struct ranked) * (n + 1));
+    element_t **expect = malloc(sizeof(element_t *) * (n + 1));
+    if (!ranks || !expect) {
+        report(1,
+               "INTERNAL ERROR.  Could not allocate space for expected "
+               "elements");
+        free(els);
+        free(ranks);
+        free(expect);
+        return false;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        ranks[i].el = els[i];
+        ranks[i].pos = i;
+        expect[i] = els[i];
+    }
+    qsort(ranks, n, sizeof(struct ranked), cmp_ranked);
+    for (size_t i = 0, j; i < n; i = j) {
+        for (j = i + 1; j < n; j++) {
+            if (strcmp(ranks[i].el->value, ranks[j].el->value))
+                break;
+        }
+        if (j - i > 1) {
+            for (size_t k = keep_first ? i + 1 : i; k < j; k++)
+                expect[ranks[k].pos] = NULL;
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (expect[i])
+            expect[m++] = expect[i];
+    }
+    free(ranks);
+
+    bool ok = true;
+    if (exception_setup(true))
+        ok = q_delete_dup_unsorted(l_meta.l, keep_first);
+    exception_cancel();
+
+    if (!l_meta.l) {
+        report(1, "ERROR: Calling delete duplicate on null queue");
+        free(els);
+        free(expect);
+        return false;
+    }
+
+    /* Short of memory for its table, the queue is left as it was */
+    if (!ok) {
+        ok = check_elements(els, n);
+        free(els);
+        free(expect);
+        if (!ok)
+            return false;
+
+        fail_count++;
+        if (fail_count < fail_limit) {
+            report(2, "Delete duplicate failed");
+        } else {
+            report(1, "ERROR: Delete duplicate failed (%d failures total)",
+                   fail_count);
+            return false;
+        }
+        show_queue(3);
+        return !error_check();
+    }
+
+    ok = check_elements(expect, m);
+    free(els);
+    free(expect);
     show_queue(3);
+
     return ok && !error_check();
 }
 
@@ -791,6 +1367,7 @@ static bool do_shuffle(int argc, char *argv[])
         // remove and add to tail
         list_move_tail(p, l_meta.l);
     }
+    q_reindex(l_meta.l);
 
     show_queue(3);
     return !error_check();
@@ -798,8 +1375,8 @@ static bool do_shuffle(int argc, char *argv[])
 
 int cmp(struct list_head *a, struct list_head *b)
 {
-    return strcmp(list_entry(a, element_t, list)->value,
-                  list_entry(b, element_t, list)->value);
+    return q_cmp(list_entry(a, element_t, list),
+                 list_entry(b, element_t, list));
 }
 
 bool do_lsort(int argc, char *argv[])
@@ -820,33 +1397,168 @@ bool do_lsort(int argc, char *argv[])
 
     list_cmp_func_t lcmp = (list_cmp_func_t) &cmp;
 
+    /* An alarm during the sort must wait for the index to be rebuilt */
+    sigset_t alarm, old;
+    sigemptyset(&alarm);
+    sigaddset(&alarm, SIGALRM);
+
     set_noallocate_mode(true);
-    if (exception_setup(true))
-        list_sort(l_meta.l, lcmp);
+    if (exception_setup(true)) {
+        pthread_sigmask(SIG_BLOCK, &alarm, &old);
+        list_sort_parallel(l_meta.l, lcmp, sort_threads);
+        q_reindex(l_meta.l);
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+    }
     exception_cancel();
     set_noallocate_mode(false);
 
+    bool ok = check_order(cnt);
+
+    show_queue(3);
+    return ok && !error_check();
+}
+
+bool do_lrsort(int argc, char *argv[])
+{
+    return sort_and_check(argc, argv, q_radix_sort);
+}
+
+static bool do_memstat(int argc, char *argv[])
+{
+    bool reset = argc == 2 && !strcmp(argv[1], "reset");
+
+    if (argc > 2 || (argc == 2 && !reset)) {
+        report(1, "%s takes no arguments but reset", argv[0]);
+        return false;
+    }
+
+    allocation_profile(reset);
+    return true;
+}
+
+static bool do_malloc_site(int argc, char *argv[])
+{
+    if (argc > 2) {
+        report(1, "%s takes 0-1 arguments", argv[0]);
+        return false;
+    }
+
+    if (argc == 1)
+        return fail_at_site(NULL, 0);
+
+    /* Sites are named file:line, as in the output of memstat */
+    char *colon = strrchr(argv[1], ':');
+    int line;
+    if (!colon || colon == argv[1] || !get_int(colon + 1, &line) ||
+        line <= 0) {
+        report(1, "Invalid call site '%s', expected file:line", argv[1]);
+        return false;
+    }
+
+    *colon = '\0';
+    bool ok = fail_at_site(argv[1], line);
+    *colon = ':';
+    if (!ok)
+        report(1, "Could not set call site '%s'", argv[1]);
+    return ok;
+}
+
+/* Whether the first len bytes of the scratch block p hold their letters */
+static bool scratch_intact(const char *p, int len)
+{
+    for (int i = 0; i < len; i++) {
+        if (p[i] != charset[i % (sizeof charset - 1)])
+            return false;
+    }
+    return true;
+}
+
+static bool do_realloc(int argc, char *argv[])
+{
+    bool expect_fail = argc == 3 && !strcmp(argv[2], "fail");
+    int size;
+
+    if (argc != 2 && !expect_fail) {
+        report(1, "%s needs 1 argument, then optionally fail", argv[0]);
+        return false;
+    }
+    if (!get_int(argv[1], &size) || size < 0) {
+        report(1, "Invalid block size '%s'", argv[1]);
+        return false;
+    }
+
+    char *p = NULL;
+    if (exception_setup(true))
+        p = test_realloc(scratch, size);
+    exception_cancel();
+
     bool ok = true;
-    if (l_meta.size) {
-        for (struct list_head *cur_l = l_meta.l->next;
-             cur_l != l_meta.l && --cnt; cur_l = cur_l->next) {
-            /* Ensure each element in ascending order */
-            /* FIXME: add an option to specify sorting order */
-            element_t *item, *next_item;
-            item = list_entry(cur_l, element_t, list);
-            next_item = list_entry(cur_l->next, element_t, list);
-            if (strcasecmp(item->value, next_item->value) > 0) {
-                report(1, "ERROR: Not sorted in ascending order");
+    if (scratch && !size) {
+        if (expect_fail) {
+            report(1, "ERROR: Freeing the block cannot fail");
+            ok = false;
+        } else {
+            report(2, "Freed block");
+        }
+        scratch = NULL;
+        scratch_size = 0;
+        return ok && !error_check();
+    }
+
+    /* A failed realloc must leave the block as it was */
+    if (!p) {
+        if (scratch && !scratch_intact(scratch, scratch_size)) {
+            report(1, "ERROR: Failed realloc changed the block");
+            ok = false;
+        } else if (expect_fail) {
+            report(2, "Resizing block to %d bytes failed", size);
+        } else {
+            fail_count++;
+            if (fail_count < fail_limit) {
+                report(2, "Resizing block to %d bytes failed", size);
+            } else {
+                report(1,
+                       "ERROR: Resizing block to %d bytes failed (%d failures "
+                       "total)",
+                       size, fail_count);
                 ok = false;
-                break;
             }
         }
+        return ok && !error_check();
     }
 
-    show_queue(3);
+    if (expect_fail) {
+        report(1, "ERROR: Resizing block to %d bytes should have failed",
+               size);
+        ok = false;
+    }
+
+    int kept = size < scratch_size ? size : scratch_size;
+    if (!scratch_intact(p, kept)) {
+        report(1, "ERROR: Realloc lost the contents of the block");
+        ok = false;
+    } else if (!scratch) {
+        report(2, "Allocated block of %d bytes", size);
+    } else if (p == scratch) {
+        report(2, "Resized block to %d bytes in place", size);
+    } else {
+        report(2, "Moved block to hold %d bytes", size);
+    }
+
+    for (int i = kept; i < size; i++)
+        p[i] = charset[i % (sizeof charset - 1)];
+    scratch = p;
+    scratch_size = size;
+
     return ok && !error_check();
 }
 
+/* Replay malloc failures from the start when their schedule changes */
+static void restart_faults(int oldval)
+{
+    fail_restart();
+}
+
 static void console_init()
 {
     ADD_COMMAND(new, "                | Create new queue");
@@ -876,20 +1588,63 @@ static void console_init()
         size, " [n]            | Compute queue size n times (default: n == 1)");
     ADD_COMMAND(show, "                | Show queue contents");
     ADD_COMMAND(dm, "                | Delete middle node in queue");
+    ADD_COMMAND(is,
+                " str [n]        | Insert string str in ascending order n "
+                "times (default: n == 1)");
+    ADD_COMMAND(find, " str            | Find element holding string str");
+    ADD_COMMAND(range,
+                " lo hi          | Remove elements holding strings from lo "
+                "to hi");
+    ADD_COMMAND(get, " i              | Show element with 0-based index i");
+    ADD_COMMAND(delat, " i              | Delete element with 0-based index i");
     ADD_COMMAND(
         dedup, "                | Delete all nodes that have duplicate string");
+    ADD_COMMAND(udedup,
+                " [first]        | Delete all nodes that have duplicate "
+                "string, or all but the first, in unsorted queue");
     ADD_COMMAND(swap,
                 "                | Swap every two adjacent nodes in queue");
     ADD_COMMAND(shuffle, "                | Shuffle the queue");
     ADD_COMMAND(lsort,
                 "                | Sort queue in ascending order, but with "
                 "linux method");
+    ADD_COMMAND(lrsort,
+                "                | Sort queue in ascending order, but with "
+                "radix sort");
+    ADD_COMMAND(malloc_site,
+                " [file:line]    | Only let mallocs at this call site fail, "
+                "or any if none given");
+    ADD_COMMAND(realloc,
+                " n [fail]       | Resize a test block to n bytes with "
+                "realloc, and free it if 0");
+    ADD_COMMAND(memstat,
+                " [reset]        | Show allocations per call site, or clear "
+                "the statistics");
     add_param("length", &string_length, "Maximum length of displayed string",
               NULL);
     add_param("malloc", &fail_probability, "Malloc failure probability percent",
               NULL);
+    add_param("malloc_bp", &fail_basis_points,
+              "Malloc failure probability in basis points, added to malloc",
+              NULL);
+    add_param("malloc_every", &fail_every,
+              "Make every Nth eligible malloc fail (0: off)", restart_faults);
+    add_param("malloc_size", &fail_min_size,
+              "Only mallocs of at least this many bytes may fail (0: any)",
+              NULL);
+    add_param("malloc_seed", &fail_seed,
+              "Seed of malloc failures, set to replay them", restart_faults);
+    add_param("fast", &fast_mode,
+              "Only count allocations, skipping all checks (0: off)", NULL);
+    add_param("guard", &guard_pages,
+              "Guard page after (1) or before (2) each block, or none (0)",
+              NULL);
     add_param("fail", &fail_limit,
               "Number of times allow queue operations to return false", NULL);
+    add_param("threads", &sort_threads, "Number of threads used by lsort",
+              NULL);
+    add_param("intern", &intern_mode,
+              "Share one copy of equal strings in queues made by new", NULL);
 }
 
 /* Signal handlers */
@@ -920,13 +1675,11 @@ static void queue_init()
 static bool queue_quit(int argc, char *argv[])
 {
     report(3, "Freeing queue");
-    if (lcnt > big_list_size)
-        set_cautious_mode(false);
 
     if (exception_setup(true))
         q_free(l_meta.l);
     exception_cancel();
-    set_cautious_mode(true);
+    test_free(scratch);
 
     size_t bcnt = allocation_check();
     if (bcnt > 0) {
@@ -940,11 +1693,14 @@ static bool queue_quit(int argc, char *argv[])
 
 static void usage(char *cmd)
 {
-    printf("Usage: %s [-h] [-f IFILE][-v VLEVEL][-l LFILE]\n", cmd);
+    printf("Usage: %s [-h] [-f IFILE][-v VLEVEL][-l LFILE][-g GUARD][-F]\n",
+           cmd);
     printf("\t-h         Print this information\n");
     printf("\t-f IFILE   Read commands from IFILE\n");
     printf("\t-v VLEVEL  Set verbosity level\n");
     printf("\t-l LFILE   Echo results to LFILE\n");
+    printf("\t-g GUARD   Set guard page mode (see option guard)\n");
+    printf("\t-F         Start in fast mode (see option fast)\n");
     exit(0);
 }
 
@@ -996,7 +1752,7 @@ int main(int argc, char *argv[])
     int level = 4;
     int c;
 
-    while ((c = getopt(argc, argv, "hv:f:l:")) != -1) {
+    while ((c = getopt(argc, argv, "hv:f:l:g:F")) != -1) {
         switch (c) {
         case 'h':
             usage(argv[0]);
@@ -1021,6 +1777,20 @@ int main(int argc, char *argv[])
             buf[BUFSIZE - 1] = '\0';
             logfile_name = lbuf;
             break;
+        case 'g': {
+            char *endptr;
+            errno = 0;
+            guard_pages = strtol(optarg, &endptr, 10);
+            if (errno != 0 || endptr == optarg || guard_pages < GUARD_OFF ||
+                guard_pages > GUARD_BEFORE) {
+                fprintf(stderr, "Invalid guard page mode\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        }
+        case 'F':
+            fast_mode = 1;
+            break;
         default:
             printf("Unknown option '%c'\n", c);
             usage(argv[0]);
@@ -1,3 +1,4 @@
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,14 +18,40 @@
  */
 struct list_head *q_new()
 {
-    struct list_head *head = malloc(sizeof(struct list_head));
+    queue_t *q = malloc(sizeof(queue_t));
 
-    if (!head)
+    if (!q)
         return NULL;
 
-    INIT_LIST_HEAD(head);
+    INIT_LIST_HEAD(&q->head);
+    q->size = 0;
+    q->sorted = true;
+    q->nspilled = 0;
+    for (int i = 0; i < Q_POOL_CLASSES; i++)
+        pool_init(&q->pools[i], sizeof(element_t) + (Q_POOL_MIN_STR << i));
+    q->intern = false;
+    pool_init(&q->shared, sizeof(element_t));
+    q->strings.slots = NULL;
+    q->strings.bits = 0;
+    q->strings.count = 0;
+
+    /* Have the first slab ready so the first insertion is as cheap as the
+     * following ones
+     */
+    if (!pool_reserve(&q->pools[0])) {
+        free(q);
+        return NULL;
+    }
 
-    return head;
+#ifdef QUEUE_CHUNKED
+    if (!deque_init(&q->index)) {
+        pool_destroy(&q->pools[0]);
+        free(q);
+        return NULL;
+    }
+#endif
+
+    return &q->head;
 }
 
 /* Free all storage used by queue */
@@ -33,12 +60,301 @@ void q_free(struct list_head *l)
     if (!l)
         return;
 
-    element_t *entry, *safe;
+    queue_t *q = queue_of(l);
+
+    /* Elements go away with their slabs, only spilled strings need a walk */
+    if (q->nspilled) {
+        element_t *entry;
+
+        list_for_each_entry (entry, l, list)
+            if (entry->value != entry->data)
+                free(entry->value);
+    }
+
+    /* Shared strings all are in the table */
+    if (q->strings.slots) {
+        for (size_t i = 0; i < (size_t) 1 << q->strings.bits; i++)
+            free(q->strings.slots[i]);
+        free(q->strings.slots);
+    }
+
+    for (int i = 0; i < Q_POOL_CLASSES; i++)
+        pool_destroy(&q->pools[i]);
+    pool_destroy(&q->shared);
+#ifdef QUEUE_CHUNKED
+    deque_destroy(&q->index);
+#endif
+
+    free(q);
+}
+
+/* Build the comparison key of string s, which takes len bytes */
+static inline uint64_t str_key(const char *s, size_t len)
+{
+    uint64_t key = 0;
+
+    memcpy(&key, s, len < Q_KEY_LEN ? len : Q_KEY_LEN);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    key = __builtin_bswap64(key);
+#endif
+    return key;
+}
+
+/* String shared by the elements of a queue in interning mode */
+struct q_string {
+    size_t refs; /* Number of elements holding it */
+    uint64_t hash;
+    char s[];
+};
+
+/* Hash of string s (FNV-1a) */
+static inline uint64_t str_hash(const char *s)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (; *s; s++)
+        h = (h ^ (unsigned char) *s) * 0x100000001b3ULL;
+    return h;
+}
+
+/* Home slot of hash in table t */
+static inline size_t strtab_home(const q_strtab_t *t, uint64_t hash)
+{
+    return (size_t) ((hash * 0x9E3779B97F4A7C15ULL) >> (64 - t->bits));
+}
+
+/*
+ * Move the strings of table t to a table of 2^bits slots.
+ * Return false, keeping the current table, if could not allocate it.
+ */
+static bool strtab_resize(q_strtab_t *t, unsigned int bits)
+{
+    struct q_string **old = t->slots;
+    size_t old_cap = old ? (size_t) 1 << t->bits : 0;
+
+    struct q_string **slots = malloc(sizeof(*slots) << bits);
+    if (!slots)
+        return false;
+    memset(slots, 0, sizeof(*slots) << bits);
+
+    t->slots = slots;
+    t->bits = bits;
+    size_t mask = ((size_t) 1 << bits) - 1;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (!old[i])
+            continue;
+        size_t j = strtab_home(t, old[i]->hash);
+        while (slots[j])
+            j = (j + 1) & mask;
+        slots[j] = old[i];
+    }
+    free(old);
+    return true;
+}
+
+/*
+ * Get a reference to the copy of string s, which takes len bytes, in the
+ * table of queue q, adding one if there is none.
+ * Return NULL if could not allocate space.
+ */
+static char *intern(queue_t *q, const char *s, size_t len)
+{
+    q_strtab_t *t = &q->strings;
+
+    if (2 * (t->count + 1) > ((size_t) 1 << t->bits) &&
+        !strtab_resize(t, t->slots ? t->bits + 1 : 6))
+        return NULL;
+
+    uint64_t hash = str_hash(s);
+    size_t mask = ((size_t) 1 << t->bits) - 1;
+    size_t i = strtab_home(t, hash);
+    for (; t->slots[i]; i = (i + 1) & mask) {
+        struct q_string *str = t->slots[i];
+        if (str->hash == hash && !strcmp(str->s, s)) {
+            str->refs++;
+            return str->s;
+        }
+    }
+
+    struct q_string *str = malloc(sizeof(struct q_string) + len);
+    if (!str)
+        return NULL;
+    str->refs = 1;
+    str->hash = hash;
+    memcpy(str->s, s, len);
+    t->slots[i] = str;
+    t->count++;
+    return str->s;
+}
+
+/* Whether element e holds a string shared through the table of its queue */
+static inline bool is_shared(const element_t *e)
+{
+    /* Only the shared pool has objects too small for any inline string */
+    return e->pool->obj_size < sizeof(element_t) + Q_POOL_MIN_STR;
+}
+
+/* Drop the reference of shared element e to its string */
+static void unintern(element_t *e)
+{
+    struct q_string *str =
+        (struct q_string *) (e->value - offsetof(struct q_string, s));
+    if (--str->refs)
+        return;
+
+    /* Remove it from the table, shifting back the strings further along its
+     * probe sequence so that no lookup stops short of them
+     */
+    q_strtab_t *t = &list_entry(e->pool, queue_t, shared)->strings;
+    size_t mask = ((size_t) 1 << t->bits) - 1;
+    size_t i = strtab_home(t, str->hash);
+    while (t->slots[i] != str)
+        i = (i + 1) & mask;
+    for (size_t j = (i + 1) & mask; t->slots[j]; j = (j + 1) & mask) {
+        if (((j - strtab_home(t, t->slots[j]->hash)) & mask) >=
+            ((j - i) & mask)) {
+            t->slots[i] = t->slots[j];
+            i = j;
+        }
+    }
+    t->slots[i] = NULL;
+    t->count--;
+    free(str);
+}
+
+bool q_set_intern(struct list_head *head, bool on)
+{
+    if (!head || !list_empty(head))
+        return false;
 
-    list_for_each_entry_safe (entry, safe, l, list)
-        q_release_element(entry);
+    queue_of(head)->intern = on;
+    return true;
+}
+
+/* Pool for elements holding strings of len bytes, null included */
+static inline int pool_class(size_t len)
+{
+    int c = 0;
 
-    free(l);
+    if (len > Q_SSO_MAX)
+        return 0;
+    while (c < Q_POOL_CLASSES - 1 && len > (Q_POOL_MIN_STR << c))
+        c++;
+    return c;
+}
+
+/*
+ * Allocate an element of queue q holding a copy of string s, which takes
+ * len bytes.
+ * Strings of up to Q_SSO_MAX bytes are stored inline, right behind the
+ * element, in a slot of the pool of matching size, so that the element and
+ * its string share the same cache lines and cost no call to malloc().
+ * Longer strings spill to a block of their own.
+ * Return NULL if could not allocate space.
+ */
+static inline element_t *new_element(queue_t *q, const char *s, size_t len)
+{
+    if (q->intern) {
+        element_t *el = pool_alloc(&q->shared);
+        if (!el)
+            return NULL;
+        el->pool = &q->shared;
+        el->value = intern(q, s, len);
+        if (!el->value) {
+            pool_free(el->pool, el);
+            return NULL;
+        }
+        el->key = str_key(s, len);
+        return el;
+    }
+
+    int c = pool_class(len);
+    element_t *el = pool_alloc(&q->pools[c]);
+    if (!el)
+        return NULL;
+    el->pool = &q->pools[c];
+
+    if (len > Q_SSO_MAX) {
+        el->value = malloc(sizeof(char) * len);
+        if (!el->value) {
+            pool_free(el->pool, el);
+            return NULL;
+        }
+    } else {
+        el->value = el->data;
+    }
+    memcpy(el->value, s, len);
+    el->key = str_key(s, len);
+
+    return el;
+}
+
+/* Account for element el being linked into queue q */
+static inline void account_add(queue_t *q, const element_t *el)
+{
+    q->size++;
+    if (el->value != el->data && !q->intern)
+        q->nspilled++;
+}
+
+/* Account for element el being unlinked from queue q */
+static inline void account_del(queue_t *q, const element_t *el)
+{
+    q->size--;
+    if (el->value != el->data && !q->intern)
+        q->nspilled--;
+}
+
+#ifdef QUEUE_CHUNKED
+/* Rebuild the links of queue q following the order of its index */
+static void relink(queue_t *q)
+{
+    struct list_head *prev = &q->head;
+    deque_pos_t pos;
+    void **slot;
+
+    deque_rewind(&q->index, &pos);
+    while ((slot = deque_next(&q->index, &pos))) {
+        element_t *el = *slot;
+        prev->next = &el->list;
+        el->list.prev = prev;
+        prev = &el->list;
+    }
+    prev->next = &q->head;
+    q->head.prev = prev;
+}
+#endif
+
+/*
+ * For internal use.
+ * Tell whether the nodes from the one before first to the one after last,
+ * the list head aside, are in ascending order.
+ */
+static bool in_order(struct list_head *head, struct list_head *first,
+                     struct list_head *last)
+{
+    struct list_head *p = first->prev == head ? first : first->prev;
+    struct list_head *end = last->next == head ? last : last->next;
+
+    for (; p != end; p = p->next) {
+        if (q_cmp(list_entry(p, element_t, list),
+                  list_entry(p->next, element_t, list)) > 0)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Whether queue q is known to be in ascending order. Builds with QUEUE_DEBUG
+ * walk the whole queue to check that the flag tells the truth, since a stale
+ * one quietly turns lookups into binary searches of an unsorted queue.
+ */
+static inline bool known_sorted(queue_t *q)
+{
+#ifdef QUEUE_DEBUG
+    assert(!q->sorted || in_order(&q->head, q->head.next, q->head.prev));
+#endif
+    return q->sorted;
 }
 
 /*
@@ -53,19 +369,21 @@ bool q_insert_head(struct list_head *head, char *s)
     if (!head)
         return false;
 
-    element_t *el = malloc(sizeof(element_t));
+    queue_t *q = queue_of(head);
+    element_t *el = new_element(q, s, strlen(s) + 1);
     if (!el)
         return false;
 
-    size_t len = strlen(s) + 1;
-    el->value = malloc(sizeof(char) * len);
-    if (!el->value) {
-        free(el);
+#ifdef QUEUE_CHUNKED
+    if (!deque_push_head(&q->index, el)) {
+        q_release_element(el);
         return false;
     }
-    memcpy(el->value, s, len);
-
+#endif
     list_add(&el->list, head);
+    account_add(q, el);
+    if (q->sorted)
+        q->sorted = in_order(head, &el->list, &el->list);
 
     return true;
 }
@@ -82,23 +400,217 @@ bool q_insert_tail(struct list_head *head, char *s)
     if (!head)
         return false;
 
-    element_t *el = malloc(sizeof(element_t));
+    queue_t *q = queue_of(head);
+    element_t *el = new_element(q, s, strlen(s) + 1);
     if (!el)
         return false;
 
-    size_t len = strlen(s) + 1;
-    el->value = malloc(sizeof(char) * len);
-    if (!el->value) {
-        free(el);
+#ifdef QUEUE_CHUNKED
+    if (!deque_push_tail(&q->index, el)) {
+        q_release_element(el);
         return false;
     }
-    memcpy(el->value, s, len);
-
+#endif
     list_add_tail(&el->list, head);
+    account_add(q, el);
+    if (q->sorted)
+        q->sorted = in_order(head, &el->list, &el->list);
 
     return true;
 }
 
+/*
+ * Insert copies of strs[0 .. n - 1] as q_insert_head() or q_insert_tail()
+ * would one after the other, but taking the elements from one slab per
+ * pool and linking them in all at once.
+ * Return false, inserting none, if q is NULL or could not allocate space.
+ */
+static bool insert_bulk(struct list_head *head, char **strs, size_t n,
+                        bool tail)
+{
+    if (!head)
+        return false;
+
+    queue_t *q = queue_of(head);
+    size_t need[Q_POOL_CLASSES] = {0};
+
+    if (q->intern) {
+        if (!pool_reserve_n(&q->shared, n))
+            return false;
+    } else {
+        for (size_t i = 0; i < n; i++)
+            need[pool_class(strlen(strs[i]) + 1)]++;
+        for (int c = 0; c < Q_POOL_CLASSES; c++)
+            if (need[c] && !pool_reserve_n(&q->pools[c], need[c]))
+                return false;
+    }
+
+    /* Chain the elements in their final order, then splice the chain */
+    LIST_HEAD(chain);
+    element_t *el, *safe;
+    size_t built = 0;
+    for (; built < n; built++) {
+        el = new_element(q, strs[built], strlen(strs[built]) + 1);
+        if (!el)
+            goto undo;
+        if (tail)
+            list_add_tail(&el->list, &chain);
+        else
+            list_add(&el->list, &chain);
+    }
+
+#ifdef QUEUE_CHUNKED
+    /* Index the elements in insertion order, which is the chain backwards
+     * when inserting at head
+     */
+    size_t pushed = 0;
+    if (tail) {
+        list_for_each_entry (el, &chain, list) {
+            if (!deque_push_tail(&q->index, el))
+                break;
+            pushed++;
+        }
+    } else {
+        for (struct list_head *node = chain.prev; node != &chain;
+             node = node->prev) {
+            if (!deque_push_head(&q->index,
+                                 list_entry(node, element_t, list)))
+                break;
+            pushed++;
+        }
+    }
+    if (pushed < n) {
+        for (; pushed; pushed--) {
+            if (tail)
+                deque_pop_tail(&q->index);
+            else
+                deque_pop_head(&q->index);
+        }
+        goto undo;
+    }
+#endif
+
+    list_for_each_entry (el, &chain, list)
+        account_add(q, el);
+    struct list_head *first = chain.next, *last = chain.prev;
+    if (tail)
+        list_splice_tail(&chain, head);
+    else
+        list_splice(&chain, head);
+    if (q->sorted && n)
+        q->sorted = in_order(head, first, last);
+    return true;
+
+undo:
+    list_for_each_entry_safe (el, safe, &chain, list)
+        q_release_element(el);
+    return false;
+}
+
+bool q_insert_head_bulk(struct list_head *head, char **strs, size_t n)
+{
+    return insert_bulk(head, strs, n, false);
+}
+
+bool q_insert_tail_bulk(struct list_head *head, char **strs, size_t n)
+{
+    return insert_bulk(head, strs, n, true);
+}
+
+/* Make element probe a key to compare elements of a queue with string s */
+static inline void make_probe(element_t *probe, const char *s)
+{
+    probe->value = (char *) s;
+    probe->key = str_key(s, strlen(s) + 1);
+}
+
+#ifdef QUEUE_CHUNKED
+static int cmp_entry(const void *entry, const void *key)
+{
+    return q_cmp(entry, key);
+}
+#endif
+
+/*
+ * For internal use.
+ * Get the first node of queue q, which must be sorted, whose element compares
+ * above key, or not below key unless upper. Return the list head if there is
+ * none. Under QUEUE_CHUNKED, the index is binary searched and *index is set to
+ * the position of the node. Otherwise the list is walked back from its tail,
+ * so that finding room for strings coming in ascending order stays cheap.
+ */
+static struct list_head *bound(queue_t *q, const element_t *key, bool upper,
+                               size_t *index)
+{
+#ifdef QUEUE_CHUNKED
+    size_t n = deque_search(&q->index, key, cmp_entry, upper);
+
+    *index = n;
+    if (n == q->size)
+        return &q->head;
+    return &((element_t *) deque_get(&q->index, n))->list;
+#else
+    int limit = upper ? 0 : -1;
+    struct list_head *p = q->head.prev;
+
+    (void) index;
+    while (p != &q->head && q_cmp(list_entry(p, element_t, list), key) > limit)
+        p = p->prev;
+    return p->next;
+#endif
+}
+
+bool q_insert_sorted(struct list_head *head, char *s)
+{
+    if (!head)
+        return false;
+
+    queue_t *q = queue_of(head);
+    q_sort(head);
+
+    element_t *el = new_element(q, s, strlen(s) + 1);
+    if (!el)
+        return false;
+
+    /* After the elements holding the same string */
+    size_t n;
+    struct list_head *next = bound(q, el, true, &n);
+#ifdef QUEUE_CHUNKED
+    if (!deque_insert(&q->index, n, el)) {
+        q_release_element(el);
+        return false;
+    }
+#endif
+    list_add_tail(&el->list, next);
+    account_add(q, el);
+
+    return true;
+}
+
+element_t *q_find(struct list_head *head, const char *s)
+{
+    if (!head)
+        return NULL;
+
+    queue_t *q = queue_of(head);
+    element_t probe, *el;
+    make_probe(&probe, s);
+
+    if (!known_sorted(q)) {
+        list_for_each_entry (el, head, list)
+            if (!q_cmp(el, &probe))
+                return el;
+        return NULL;
+    }
+
+    size_t n;
+    struct list_head *p = bound(q, &probe, false, &n);
+    if (p == head)
+        return NULL;
+    el = list_entry(p, element_t, list);
+    return q_cmp(el, &probe) ? NULL : el;
+}
+
 /*
  * Attempt to remove element from head of queue.
  * Return target element.
@@ -128,6 +640,10 @@ element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize)
     *(sp + len * sizeof(char)) = '\0';
 
     list_del(node);
+    account_del(queue_of(head), el);
+#ifdef QUEUE_CHUNKED
+    deque_pop_head(&queue_of(head)->index);
+#endif
 
     return el;
 }
@@ -151,6 +667,10 @@ element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize)
     *(sp + len * sizeof(char)) = '\0';
 
     list_del(node);
+    account_del(queue_of(head), el);
+#ifdef QUEUE_CHUNKED
+    deque_pop_tail(&queue_of(head)->index);
+#endif
 
     return el;
 }
@@ -161,8 +681,11 @@ element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize)
  */
 void q_release_element(element_t *e)
 {
-    free(e->value);
-    free(e);
+    if (is_shared(e))
+        unintern(e);
+    else if (e->value != e->data)
+        free(e->value);
+    pool_free(e->pool, e);
 }
 
 /*
@@ -174,24 +697,80 @@ int q_size(struct list_head *head)
     if (!head)
         return 0;
 
-    int len = 0;
-    struct list_head *pos;
-    list_for_each (pos, head)
-        len++;
-    return len;
+    return queue_of(head)->size;
 }
 
 /*
- * Delete a node.
+ * Delete a node of queue q.
  * i.e. remove and release the corresponding element
  */
-#define del_node(node)                                     \
+#define del_node(q, node)                                  \
     {                                                      \
         element_t *el = list_entry(node, element_t, list); \
         list_del(node);                                    \
+        account_del(q, el);                                \
         q_release_element(el);                             \
     }
 
+#ifndef QUEUE_CHUNKED
+/*
+ * For internal use.
+ * Get the node with 0-based index i, walking from whichever end is nearer.
+ */
+static struct list_head *nth_node(struct list_head *head, size_t i)
+{
+    size_t size = queue_of(head)->size;
+    struct list_head *p;
+
+    if (i < size / 2) {
+        for (p = head->next; i; i--)
+            p = p->next;
+    } else {
+        for (p = head->prev, i = size - 1 - i; i; i--)
+            p = p->prev;
+    }
+    return p;
+}
+#endif
+
+/*
+ * Get the element with 0-based index i.
+ * Return NULL if list is NULL or holds no more than i elements.
+ */
+element_t *q_get(struct list_head *head, size_t i)
+{
+    if (!head || i >= queue_of(head)->size)
+        return NULL;
+
+#ifdef QUEUE_CHUNKED
+    return deque_get(&queue_of(head)->index, i);
+#else
+    return list_entry(nth_node(head, i), element_t, list);
+#endif
+}
+
+/*
+ * Delete the element with 0-based index i.
+ * Return true if successful.
+ * Return false if list is NULL or holds no more than i elements.
+ */
+bool q_delete_at(struct list_head *head, size_t i)
+{
+    if (!head || i >= queue_of(head)->size)
+        return false;
+
+#ifdef QUEUE_CHUNKED
+    /* The index finds the node through its tree of chunk sizes */
+    element_t *el = deque_erase(&queue_of(head)->index, i);
+    struct list_head *p = &el->list;
+#else
+    struct list_head *p = nth_node(head, i);
+#endif
+    del_node(queue_of(head), p);
+
+    return true;
+}
+
 /*
  * Delete the middle node in list.
  * The middle node of a linked list of size n is the
@@ -204,33 +783,25 @@ bool q_delete_mid(struct list_head *head)
 {
     // https://leetcode.com/problems/delete-the-middle-node-of-a-linked-list/
 
-    if (!head || list_empty(head))
-        return false;
-
-    // squeeze to find the middle-node
-    struct list_head *p = head->next;
-    int hindex = 0, tindex = q_size(head) - 1;  // O(n)
-
-    for (; hindex < tindex; hindex++, tindex--, p = p->next)
-        ;
-
-    /*
-     * hp: go from head to tail
-     * tp: go from tail to head
-     * odd nodes: head -> ... -> hp == tp -> ...
-     * even nodes: head -> ... -> tp -> hp -> ...
-     * thus delete "hp"
-     * => simplify to one pointer p
-     */
-    del_node(p);  // delete middle node
-
-    return true;
+    return head && q_delete_at(head, queue_of(head)->size / 2);
 }
 
 /*
  * Get the value of corresponding element of node.
  */
-#define get_value(node) list_entry(node, element_t, list)->value
+#define get_element(node) list_entry(node, element_t, list)
+#define get_value(node) get_element(node)->value
+
+/* Whether elements a and b of queue q hold equal strings */
+static inline bool same_string(const queue_t *q,
+                               const element_t *a,
+                               const element_t *b)
+{
+    /* Interned strings are equal only if they are the same copy */
+    if (q->intern)
+        return a->value == b->value;
+    return q_cmp(a, b) == 0;
+}
 
 /*
  * Delete all nodes that have duplicate string,
@@ -251,28 +822,231 @@ bool q_delete_dup(struct list_head *head)
     if (list_empty(head))
         return true;
 
+    queue_t *q = queue_of(head);
+
+#ifdef QUEUE_CHUNKED
+    /*
+     * Scan the index, keeping the previous element back until the next one
+     * tells whether it is part of a run of duplicates. Survivors are written
+     * back to the front of the index, and the links are rebuilt once at the
+     * end.
+     */
+    deque_pos_t rpos, wpos;
+    void **slot;
+    element_t *prev = NULL;
+    bool dup = false;
+
+    deque_rewind(&q->index, &rpos);
+    wpos = rpos;
+    while ((slot = deque_next(&q->index, &rpos))) {
+        element_t *el = *slot;
+        if (prev && same_string(q, prev, el)) {
+            account_del(q, prev);
+            q_release_element(prev);
+            dup = true;
+        } else if (prev) {
+            if (dup) {
+                account_del(q, prev);
+                q_release_element(prev);
+            } else {
+                *deque_next(&q->index, &wpos) = prev;
+            }
+            dup = false;
+        }
+        prev = el;
+    }
+    if (dup) {
+        account_del(q, prev);
+        q_release_element(prev);
+    } else {
+        *deque_next(&q->index, &wpos) = prev;
+    }
+
+    deque_truncate(&q->index, &wpos);
+    relink(q);
+#else
+    /*
+     * Compare each element once with the first of its run. A run of
+     * duplicates is released as it is scanned, without unlinking its
+     * elements one by one, then cut out of the queue all at once.
+     */
     struct list_head *p = head->next;
 
-    for (; p != head && p->next != head;) {
-        if (strcmp(get_value(p), get_value(p->next)) == 0) {
-            struct list_head *np = p->next;
-            char *str = strdup(get_value(np));
-            for (; np->next != head && strcmp(str, get_value(np->next)) == 0;) {
-                np = np->next;
-                del_node(np->prev);
+    while (p != head) {
+        struct list_head *n = p->next;
+        element_t *first = get_element(p);
+
+        if (n == head || !same_string(q, first, get_element(n))) {
+            p = n;
+            continue;
+        }
+
+        struct list_head *prev = p->prev;
+        do {
+            struct list_head *next = n->next;
+            account_del(q, get_element(n));
+            q_release_element(get_element(n));
+            n = next;
+        } while (n != head && same_string(q, first, get_element(n)));
+        account_del(q, first);
+        q_release_element(first);
+
+        prev->next = n;
+        n->prev = prev;
+        p = n;
+    }
+#endif
+
+    return true;
+}
+
+#ifdef QUEUE_CHUNKED
+/* Rewrite the index of queue q, which lost elements, from its list */
+static void reindex_shrunk(queue_t *q)
+{
+    deque_pos_t pos;
+    struct list_head *node;
+
+    deque_rewind(&q->index, &pos);
+    list_for_each (node, &q->head)
+        *deque_next(&q->index, &pos) = get_element(node);
+    deque_truncate(&q->index, &pos);
+}
+#endif
+
+/* Slot of the table of strings seen by q_delete_dup_unsorted() */
+struct seen {
+    element_t *first; /* First element holding the string */
+    uint32_t hash;    /* High bits of the hash of the string */
+    bool deleted;     /* Whether first was deleted already */
+};
+
+bool q_delete_dup_unsorted(struct list_head *head, bool keep_first)
+{
+    if (!head)
+        return false;
+
+    queue_t *q = queue_of(head);
+    if (q->size < 2)
+        return true;
+
+    unsigned int bits = 1;
+    while (((size_t) 1 << bits) < 2 * q->size)
+        bits++;
+    size_t mask = ((size_t) 1 << bits) - 1;
+    struct seen *seen = malloc(sizeof(struct seen) << bits);
+    if (!seen)
+        return false;
+    memset(seen, 0, sizeof(struct seen) << bits);
+
+    /*
+     * Deleted elements are moved to a list of their own, and only released
+     * once done, since a first one may still be compared with later ones.
+     */
+    LIST_HEAD(dups);
+    struct list_head *node, *safe;
+
+    list_for_each_safe (node, safe, head) {
+        element_t *el = get_element(node);
+        /* Interned strings are equal only if they are the same copy */
+        uint64_t hash =
+            (q->intern ? (uintptr_t) el->value : str_hash(el->value)) *
+            0x9E3779B97F4A7C15ULL;
+        size_t i = (size_t) (hash >> (64 - bits));
+        struct seen *s;
+
+        for (;; i = (i + 1) & mask) {
+            s = &seen[i];
+            if (!s->first) {
+                s->first = el;
+                s->hash = hash >> 32;
+                break;
             }
-            del_node(np);
-            free(str);  // release momery allocated by strdup
-            p = p->next;
-            del_node(p->prev);
-        } else {
-            p = p->next;
+            if (s->hash == (uint32_t) (hash >> 32) &&
+                same_string(q, s->first, el))
+                break;
+        }
+        if (s->first == el)
+            continue;
+
+        list_move_tail(node, &dups);
+        if (!keep_first && !s->deleted) {
+            list_move_tail(&s->first->list, &dups);
+            s->deleted = true;
         }
     }
+    free(seen);
+
+    element_t *el, *next;
+    list_for_each_entry_safe (el, next, &dups, list) {
+        account_del(q, el);
+        q_release_element(el);
+    }
+
+#ifdef QUEUE_CHUNKED
+    reindex_shrunk(q);
+#endif
 
     return true;
 }
 
+size_t q_extract_range(struct list_head *head,
+                       const char *lo,
+                       const char *hi,
+                       struct list_head *out)
+{
+    if (!head)
+        return 0;
+
+    queue_t *q = queue_of(head);
+    element_t plo, phi;
+    make_probe(&plo, lo);
+    make_probe(&phi, hi);
+    if (q_cmp(&plo, &phi) > 0)
+        return 0;
+
+    size_t k = 0;
+    struct list_head *node, *safe;
+
+    if (!known_sorted(q)) {
+        list_for_each_safe (node, safe, head) {
+            element_t *el = get_element(node);
+            if (q_cmp(el, &plo) >= 0 && q_cmp(el, &phi) <= 0) {
+                list_move_tail(node, out);
+                account_del(q, el);
+                k++;
+            }
+        }
+#ifdef QUEUE_CHUNKED
+        if (k)
+            reindex_shrunk(q);
+#endif
+        return k;
+    }
+
+    /* Matching elements make up the nodes from first up to end */
+    size_t a, b;
+    struct list_head *first = bound(q, &plo, false, &a);
+    struct list_head *end = bound(q, &phi, true, &b);
+    for (node = first; node != end; node = node->next, k++)
+        account_del(q, get_element(node));
+    if (!k)
+        return 0;
+
+    struct list_head *last = end->prev;
+    first->prev->next = end;
+    end->prev = first->prev;
+    first->prev = out->prev;
+    out->prev->next = first;
+    last->next = out;
+    out->prev = last;
+#ifdef QUEUE_CHUNKED
+    deque_erase_range(&q->index, a, k);
+#endif
+
+    return k;
+}
+
 /*
  * For internel use.
  * Swap two nodes(whether adjacnt or not)
@@ -313,11 +1087,37 @@ void q_swap(struct list_head *head)
     if (!head || list_empty(head))
         return;
 
+    queue_of(head)->sorted = false;
+
+#ifdef QUEUE_CHUNKED
+    queue_t *q = queue_of(head);
+    deque_pos_t pos;
+    void **a, **b;
+
+    deque_rewind(&q->index, &pos);
+    while ((a = deque_next(&q->index, &pos)) &&
+           (b = deque_next(&q->index, &pos))) {
+        void *t = *a;
+        *a = *b;
+        *b = t;
+    }
+    relink(q);
+#else
     struct list_head *p = head->next;
 
     for (; p != head && p->next != head; p = p->next) {
         swap_node(p, p->next);
     }
+#endif
+}
+
+/* For internal use. Exchange the prev and next links of a node */
+static inline void flip(struct list_head *node)
+{
+    struct list_head *next = node->next;
+
+    node->next = node->prev;
+    node->prev = next;
 }
 
 /*
@@ -332,18 +1132,31 @@ void q_reverse(struct list_head *head)
     if (!head || list_empty(head))
         return;
 
-    // hp: head pointer, tp: tail pointer
-    struct list_head *hp = head->next;
-    struct list_head *tp = head->prev;
-    int hindex = 0, tindex = q_size(head) - 1;  // O(n)
+    queue_of(head)->sorted = false;
+
+#ifdef QUEUE_CHUNKED
+    deque_reverse(&queue_of(head)->index);
+    relink(queue_of(head));
+#else
+    /*
+     * Exchange prev and next of every node, the head included. Walking in
+     * from both ends keeps two independent pointer chases in flight, which
+     * is what bounds this loop on long lists.
+     */
+    struct list_head *hp = head->next, *tp = head->prev;
+    size_t pairs = queue_of(head)->size / 2;
 
-    for (; hindex < tindex; hindex++, tindex--) {
-        struct list_head *a = hp;
-        struct list_head *b = tp;
+    for (; pairs; pairs--) {
+        struct list_head *a = hp, *b = tp;
         hp = hp->next;
         tp = tp->prev;
-        swap_node(a, b);
+        flip(a);
+        flip(b);
     }
+    if (hp == tp)
+        flip(hp);
+    flip(head);
+#endif
 }
 
 /*
@@ -368,8 +1181,7 @@ static inline void splice(struct list_head *a, struct list_head *b)
 struct list_head *merge(struct list_head *r, struct list_head *l)
 {
     // for unbalanced case like 1, ..., 1 vs 2, ..., 2
-    if (strcmp(get_value(r->prev), get_value(l)) < 0 ||
-        strcmp(get_value(r->prev), get_value(l)) == 0) {
+    if (q_cmp(get_element(r->prev), get_element(l)) <= 0) {
         splice(r, l);
 #ifdef MERGE_SORT_DEBUG
         struct list_head *a;
@@ -379,7 +1191,7 @@ struct list_head *merge(struct list_head *r, struct list_head *l)
         printf("%s\n", get_value(a));
 #endif
         return r;
-    } else if (strcmp(get_value(l->prev), get_value(r)) < 0) {
+    } else if (q_cmp(get_element(l->prev), get_element(r)) < 0) {
         splice(l, r);
 #ifdef MERGE_SORT_DEBUG
         struct list_head *a;
@@ -416,7 +1228,7 @@ struct list_head *merge(struct list_head *r, struct list_head *l)
     // decide head
     struct list_head *rp = r, *lp = l;
     struct list_head **cmp;
-    cmp = (strcmp(get_value(rp), get_value(lp)) < 0) ? &rp : &lp;
+    cmp = (q_cmp(get_element(rp), get_element(lp)) < 0) ? &rp : &lp;
     struct list_head *h = *cmp;
     struct list_head *tail = h;
     *cmp = (*cmp)->next;
@@ -427,7 +1239,7 @@ struct list_head *merge(struct list_head *r, struct list_head *l)
 #endif
 
     for (cmp = NULL; rp && lp; *cmp = (*cmp)->next, tail = tail->next) {
-        cmp = (strcmp(get_value(rp), get_value(lp)) < 0) ? &rp : &lp;
+        cmp = (q_cmp(get_element(rp), get_element(lp)) < 0) ? &rp : &lp;
         tail->next = *cmp;
         (*cmp)->prev = tail;
 #ifdef MERGE_SORT_DEBUG
@@ -505,6 +1317,174 @@ struct list_head *merge_sort(struct list_head *h)
     return merge(h, p);
 }
 
+/*
+ * Bring the queue's internal bookkeeping up to date after its elements were
+ * rearranged with the list.h API directly.
+ * No effect if q is NULL.
+ */
+void q_reindex(struct list_head *head)
+{
+    if (!head)
+        return;
+
+    /* The new order is not known */
+    queue_of(head)->sorted = false;
+#ifdef QUEUE_CHUNKED
+    /* Same elements, so the chunks keep their shape and only the order of
+     * the pointers they hold changes
+     */
+    queue_t *q = queue_of(head);
+    deque_pos_t pos;
+    struct list_head *node;
+
+    deque_rewind(&q->index, &pos);
+    list_for_each (node, head)
+        *deque_next(&q->index, &pos) = list_entry(node, element_t, list);
+#endif
+}
+
+/* Runs of this many elements are sorted by insertion before being merged */
+#define SORT_RUN 16
+
+/* Entry of the array sorted by q_sort(), carrying a copy of the key so that
+ * most comparisons are settled without touching the element
+ */
+struct sort_ent {
+    uint64_t key;
+    element_t *el;
+};
+
+/* Compare two entries like strcmp() does with the strings of their elements */
+static inline int ent_cmp(const struct sort_ent *a, const struct sort_ent *b)
+{
+    if (a->key != b->key)
+        return a->key < b->key ? -1 : 1;
+    return q_cmp(a->el, b->el);
+}
+
+/*
+ * Stable bottom-up merge sort of the n entries in a, using tmp, which has
+ * room for n entries, as scratch.
+ * Return whichever of a and tmp ends up holding the sorted entries.
+ *
+ * Keys and moves only touch the two arrays, sequentially, so the hot loop is
+ * not bound by the latency of chasing list links spread all over the heap.
+ * The loop nesting is fixed, so there is no recursion whatever the input
+ * looks like.
+ */
+static struct sort_ent *sort_array(struct sort_ent *a,
+                                   struct sort_ent *tmp,
+                                   size_t n)
+{
+    for (size_t lo = 0; lo < n; lo += SORT_RUN) {
+        size_t hi = lo + SORT_RUN < n ? lo + SORT_RUN : n;
+        for (size_t i = lo + 1; i < hi; i++) {
+            struct sort_ent x = a[i];
+            size_t j = i;
+            for (; j > lo && ent_cmp(&a[j - 1], &x) > 0; j--)
+                a[j] = a[j - 1];
+            a[j] = x;
+        }
+    }
+
+    for (size_t w = SORT_RUN; w < n; w *= 2) {
+        for (size_t lo = 0; lo < n; lo += 2 * w) {
+            size_t mid = lo + w < n ? lo + w : n;
+            size_t hi = mid + w < n ? mid + w : n;
+            size_t i = lo, j = mid, k = lo;
+
+            /* Runs already in order, as in sorted or nearly sorted input */
+            if (mid == hi || ent_cmp(&a[mid - 1], &a[mid]) <= 0) {
+                memcpy(tmp + lo, a + lo, sizeof(struct sort_ent) * (hi - lo));
+                continue;
+            }
+
+            while (i < mid && j < hi)
+                tmp[k++] = ent_cmp(&a[j], &a[i]) < 0 ? a[j++] : a[i++];
+            memcpy(tmp + k, a + i, sizeof(struct sort_ent) * (mid - i));
+            k += mid - i;
+            memcpy(tmp + k, a + j, sizeof(struct sort_ent) * (hi - j));
+        }
+
+        struct sort_ent *t = a;
+        a = tmp;
+        tmp = t;
+    }
+
+    return a;
+}
+
+/*
+ * Gather the elements of queue q, in order, into the first half of an array
+ * of 2 * q->size entries, the second half being left for scratch.
+ * Return NULL if could not allocate the array.
+ */
+static struct sort_ent *gather(queue_t *q)
+{
+    struct sort_ent *a = malloc(sizeof(struct sort_ent) * 2 * q->size);
+    if (!a)
+        return NULL;
+
+    size_t i = 0;
+#ifdef QUEUE_CHUNKED
+    deque_pos_t pos;
+    void **slot;
+
+    deque_rewind(&q->index, &pos);
+    while ((slot = deque_next(&q->index, &pos))) {
+        element_t *el = *slot;
+        a[i++] = (struct sort_ent){el->key, el};
+    }
+#else
+    element_t *el;
+
+    list_for_each_entry (el, &q->head, list)
+        a[i++] = (struct sort_ent){el->key, el};
+#endif
+
+    return a;
+}
+
+/* Put the elements of queue q in the order of the q->size entries of a */
+static void scatter(queue_t *q, const struct sort_ent *a)
+{
+    size_t n = q->size;
+
+#ifdef QUEUE_CHUNKED
+    deque_pos_t pos;
+
+    deque_rewind(&q->index, &pos);
+    for (size_t i = 0; i < n; i++)
+        *deque_next(&q->index, &pos) = a[i].el;
+    relink(q);
+#else
+    struct list_head *prev = &q->head;
+    for (size_t i = 0; i < n; i++) {
+        prev->next = &a[i].el->list;
+        a[i].el->list.prev = prev;
+        prev = &a[i].el->list;
+    }
+    prev->next = &q->head;
+    q->head.prev = prev;
+#endif
+}
+
+/*
+ * Sort queue q by gathering its elements into an array, sorting the array
+ * and relinking the elements in a single pass.
+ * Return false, leaving q untouched, if could not allocate the array.
+ */
+static bool sort_by_array(queue_t *q)
+{
+    struct sort_ent *a = gather(q);
+    if (!a)
+        return false;
+
+    scatter(q, sort_array(a, a + q->size, q->size));
+    free(a);
+    return true;
+}
+
 /*
  * Sort elements of queue in ascending order
  * No effect if q is NULL or empty. In addition, if q has only one
@@ -512,9 +1492,17 @@ struct list_head *merge_sort(struct list_head *h)
  */
 void q_sort(struct list_head *head)
 {
-    if (!head || list_empty(head) || list_is_singular(head))
+    if (!head || known_sorted(queue_of(head)))
         return;
 
+    queue_of(head)->sorted = true;
+    if (list_empty(head) || list_is_singular(head))
+        return;
+
+    if (sort_by_array(queue_of(head)))
+        return;
+
+    /* Short of memory for the array, sort the list in place */
     // dehead, and remake the circle
     struct list_head *p = head->next;
     p->prev = head->prev;
@@ -528,6 +1516,9 @@ void q_sort(struct list_head *head)
     p->prev->next = head;
     p->prev = head;
 
+    q_reindex(head);
+    queue_of(head)->sorted = true;
+
 #ifdef MERGE_SORT_DEBUG
     element_t *e;
     list_for_each_entry (e, head, list)
@@ -535,3 +1526,125 @@ void q_sort(struct list_head *head)
     printf("\n");
 #endif
 }
+
+/* Buckets with fewer entries than this are left to the merge sort */
+#define RADIX_MIN 64
+
+/* Range of entries sharing their first depth bytes, yet to be sorted */
+struct radix_task {
+    size_t lo, hi, depth;
+};
+
+/* Get byte d of the string of entry e, whose first d bytes are not null */
+static inline unsigned char ent_byte(const struct sort_ent *e, size_t d)
+{
+    if (d < Q_KEY_LEN)
+        return e->key >> (8 * (Q_KEY_LEN - 1 - d));
+    return e->el->value[d];
+}
+
+/* Sort a[lo .. hi - 1] with the merge sort, using tmp[lo .. hi - 1] */
+static inline void sort_small(struct sort_ent *a,
+                              struct sort_ent *tmp,
+                              size_t lo,
+                              size_t hi)
+{
+    struct sort_ent *s = sort_array(a + lo, tmp + lo, hi - lo);
+    if (s != a + lo)
+        memcpy(a + lo, s, sizeof(struct sort_ent) * (hi - lo));
+}
+
+/*
+ * Stable MSD radix sort of the n entries in a, using tmp, which has room for
+ * n entries, as scratch.
+ * Each pass distributes a range of entries sharing a prefix into 256
+ * buckets by the next byte. Bytes within the key are read from the array
+ * itself, so the elements are only touched past the first Q_KEY_LEN bytes.
+ * Pending ranges are kept on an explicit stack rather than recursed into,
+ * since strings can be long. They are disjoint and hold at least RADIX_MIN
+ * entries each, so stack needs room for n / RADIX_MIN + 1 tasks.
+ */
+static void radix_sort_array(struct sort_ent *a,
+                             struct sort_ent *tmp,
+                             size_t n,
+                             struct radix_task *stack)
+{
+    size_t top = 0;
+
+    stack[top++] = (struct radix_task){0, n, 0};
+    while (top) {
+        struct radix_task t = stack[--top];
+        size_t count[256] = {0};
+
+        for (size_t i = t.lo; i < t.hi; i++)
+            count[ent_byte(&a[i], t.depth)]++;
+
+        /* Strings ended here, so they are all equal */
+        if (count[0] == t.hi - t.lo)
+            continue;
+
+        /* All in one bucket, as with a long common prefix: nothing moves */
+        unsigned char b0 = ent_byte(&a[t.lo], t.depth);
+        if (count[b0] == t.hi - t.lo) {
+            stack[top++] = (struct radix_task){t.lo, t.hi, t.depth + 1};
+            continue;
+        }
+
+        size_t next[256];
+        for (size_t b = 0, pos = t.lo; b < 256; b++) {
+            next[b] = pos;
+            pos += count[b];
+        }
+        for (size_t i = t.lo; i < t.hi; i++)
+            tmp[next[ent_byte(&a[i], t.depth)]++] = a[i];
+        memcpy(a + t.lo, tmp + t.lo, sizeof(struct sort_ent) * (t.hi - t.lo));
+
+        /* next[b] is now the end of bucket b; bucket 0 needs no sorting */
+        for (size_t b = 1; b < 256; b++) {
+            size_t lo = next[b] - count[b], hi = next[b];
+            if (count[b] >= RADIX_MIN)
+                stack[top++] = (struct radix_task){lo, hi, t.depth + 1};
+            else if (count[b] > 1)
+                sort_small(a, tmp, lo, hi);
+        }
+    }
+}
+
+/*
+ * Sort elements of queue in ascending order with a radix sort
+ * No effect if q is NULL or empty. In addition, if q has only one
+ * element, do nothing.
+ */
+void q_radix_sort(struct list_head *head)
+{
+    if (!head || known_sorted(queue_of(head)))
+        return;
+
+    if (list_empty(head) || list_is_singular(head)) {
+        queue_of(head)->sorted = true;
+        return;
+    }
+
+    queue_t *q = queue_of(head);
+    size_t n = q->size;
+    struct sort_ent *a = gather(q);
+    struct radix_task *stack =
+        malloc(sizeof(struct radix_task) * (n / RADIX_MIN + 1));
+
+    if (!a || !stack) {
+        free(a);
+        free(stack);
+        q_sort(head);
+        return;
+    }
+
+    if (n < RADIX_MIN)
+        sort_small(a, a + n, 0, n);
+    else
+        radix_sort_array(a, a + n, n, stack);
+    scatter(q, a);
+    q->sorted = true;
+
+    free(stack);
+    free(a);
+}
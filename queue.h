@@ -10,17 +10,110 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "deque.h"
 #include "list.h"
+#include "pool.h"
 
 /* Linked list element */
 typedef struct {
     /* Pointer to array holding string.
-     * This array needs to be explicitly allocated and freed
+     * Short strings are kept inline in data[] below (small string
+     * optimization); long ones spill to a separately allocated array.
+     * Either way, q_release_element() frees it.
      */
     char *value;
     struct list_head list;
+    /* Pool of the queue the element was carved from */
+    struct pool *pool;
+    /* First Q_KEY_LEN bytes of the string packed big-endian, zero padded,
+     * so that comparing keys as integers orders strings like strcmp()
+     */
+    uint64_t key;
+    /* Inline storage for the string, sized by the pool the element is in */
+    char data[];
 } element_t;
 
+/*
+ * Elements whose string takes up to (Q_POOL_MIN_STR << i) bytes, including
+ * the terminating null byte, come from pool i of their queue and keep the
+ * string inline. Strings longer than Q_SSO_MAX bytes spill to the heap,
+ * while their element still comes from pool 0.
+ */
+#define Q_POOL_CLASSES 4
+#define Q_POOL_MIN_STR 16
+#define Q_SSO_MAX (Q_POOL_MIN_STR << (Q_POOL_CLASSES - 1))
+
+#define Q_KEY_LEN sizeof(uint64_t)
+
+/*
+ * Table of the strings of a queue in interning mode, where elements holding
+ * equal strings share a single reference-counted copy. Open addressing with
+ * linear probing, 2^bits slots kept at most half full.
+ */
+struct q_string;
+typedef struct {
+    struct q_string **slots;
+    unsigned int bits;
+    size_t count;
+} q_strtab_t;
+
+/*
+ * Compare the strings of elements a and b like strcmp().
+ * Only strings sharing their first Q_KEY_LEN bytes are actually compared.
+ */
+static inline int q_cmp(const element_t *a, const element_t *b)
+{
+    if (a->key != b->key)
+        return a->key < b->key ? -1 : 1;
+
+    /* A string ending within the key is the whole key */
+    if (!(a->key & 0xff))
+        return 0;
+    return strcmp(a->value + Q_KEY_LEN, b->value + Q_KEY_LEN);
+}
+
+/*
+ * Queue descriptor.
+ * The list head is kept as the first member so that the "struct list_head *"
+ * handed out by q_new() keeps working with the list.h API, while the queue
+ * operations below recover the descriptor from it with queue_of().
+ */
+typedef struct {
+    struct list_head head;
+    /* Number of elements, maintained by every operation that links or
+     * unlinks an element, so that q_size() is O(1)
+     */
+    size_t size;
+    /* Set while the elements are known to be in ascending order: by the
+     * sorts, and kept by every operation which cannot break the order, so
+     * that sorting again is free and lookups may binary search
+     */
+    bool sorted;
+    /* Size-classed pools owned by the queue, released as a whole by q_free() */
+    pool_t pools[Q_POOL_CLASSES];
+    /* Number of linked elements whose string spilled to the heap */
+    size_t nspilled;
+    /* In interning mode, elements come from the shared pool, without inline
+     * storage, and point to their string in the strings table instead
+     */
+    bool intern;
+    pool_t shared;
+    q_strtab_t strings;
+#ifdef QUEUE_CHUNKED
+    /* Elements in queue order, packed in chunks of contiguous pointers.
+     * Operations walking the whole queue go through it rather than chasing
+     * the links, and rebuild the links in a single pass when they reorder
+     * elements.
+     */
+    deque_t index;
+#endif
+} queue_t;
+
+/* Get the descriptor of the queue whose list head is @h */
+#define queue_of(h) list_entry(h, queue_t, head)
+
 /* Operations on queue */
 
 /*
@@ -32,6 +125,8 @@ struct list_head *q_new();
 /*
  * Free ALL storage used by queue.
  * No effect if q is NULL
+ * Elements removed from the queue share its storage, so they must be
+ * released with q_release_element() before the queue is freed.
  */
 void q_free(struct list_head *head);
 
@@ -53,6 +148,59 @@ bool q_insert_head(struct list_head *head, char *s);
  */
 bool q_insert_tail(struct list_head *head, char *s);
 
+/*
+ * Turn interning mode on or off. In this mode, elements holding equal
+ * strings share one copy of it, which saves memory when values repeat a lot
+ * and makes equal strings have equal pointers.
+ * Return false if q is NULL or not empty.
+ */
+bool q_set_intern(struct list_head *head, bool on);
+
+/*
+ * Attempt to insert n elements holding copies of strs[0 .. n - 1], leaving
+ * the queue as n calls to q_insert_head() or q_insert_tail() in that order
+ * would.  Elements are taken from the queue's pools all at once, so this is
+ * much faster when n is large.
+ * Return true if successful.
+ * Return false, inserting nothing, if q is NULL or could not allocate space.
+ */
+bool q_insert_head_bulk(struct list_head *head, char **strs, size_t n);
+bool q_insert_tail_bulk(struct list_head *head, char **strs, size_t n);
+
+/*
+ * Attempt to insert a copy of s in ascending order, after the elements
+ * holding the same string. The queue is sorted first unless known to be
+ * in order already.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space.
+ *
+ * With QUEUE_CHUNKED, the place is found in O(log n) through the index of
+ * the queue. Otherwise the list is walked back from its tail.
+ */
+bool q_insert_sorted(struct list_head *head, char *s);
+
+/*
+ * Get the first element holding string s, which stays in the queue.
+ * Return NULL if q is NULL or there is none.
+ * Cost is the one of q_insert_sorted() if the queue is known to be in order,
+ * O(n) otherwise.
+ */
+element_t *q_find(struct list_head *head, const char *s);
+
+/*
+ * Remove the elements holding strings from lo to hi inclusive, in strcmp()
+ * order, and append them to list out, keeping their order.
+ * Return the number of elements removed, 0 if q is NULL.
+ * Like with q_remove_head(), the elements are left to the caller, who
+ * releases them with q_release_element().
+ * Cost is the one of q_find() plus the number of elements removed, and, with
+ * QUEUE_CHUNKED, the number of elements behind them.
+ */
+size_t q_extract_range(struct list_head *head,
+                       const char *lo,
+                       const char *hi,
+                       struct list_head *out);
+
 /*
  * Attempt to remove element from head of queue.
  * Return target element.
@@ -83,9 +231,28 @@ void q_release_element(element_t *e);
 /*
  * Return number of elements in queue.
  * Return 0 if q is NULL or empty
+ * The count is cached in queue_t, so it is only valid as long as elements
+ * are linked and unlinked through the operations declared here.
  */
 int q_size(struct list_head *head);
 
+/*
+ * Get the element with 0-based index i, which stays in the queue.
+ * Return NULL if list is NULL or holds no more than i elements.
+ *
+ * With QUEUE_CHUNKED, this takes O(log n) through the index of the queue.
+ * Otherwise the list is walked from whichever end is nearer.
+ */
+element_t *q_get(struct list_head *head, size_t i);
+
+/*
+ * Delete the element with 0-based index i.
+ * Return true if successful.
+ * Return false if list is NULL or holds no more than i elements.
+ * Cost is the one of q_get().
+ */
+bool q_delete_at(struct list_head *head, size_t i);
+
 /*
  * Delete the middle node in list.
  * The middle node of a linked list of size n is the
@@ -107,6 +274,15 @@ bool q_delete_mid(struct list_head *head);
  */
 bool q_delete_dup(struct list_head *head);
 
+/*
+ * Delete all nodes whose string appears more than once, or all but the
+ * first of them if keep_first, in a queue which need not be sorted.
+ * Surviving nodes keep their order.
+ * Return true if successful.
+ * Return false if list is NULL or could not allocate space.
+ */
+bool q_delete_dup_unsorted(struct list_head *head, bool keep_first);
+
 /*
  * Attempt to swap every two adjacent nodes.
  *
@@ -123,11 +299,26 @@ void q_swap(struct list_head *head);
  */
 void q_reverse(struct list_head *head);
 
+/*
+ * Bring the queue's internal bookkeeping up to date after its elements were
+ * rearranged with the list.h API directly (e.g., by list_sort), rather than
+ * through the operations declared here. The set of elements must not change.
+ * No effect if q is NULL.
+ */
+void q_reindex(struct list_head *head);
+
 /*
  * Sort elements of queue in ascending order
  * No effect if q is NULL or empty. In addition, if q has only one
- * element, do nothing.
+ * element, do nothing. Neither if q is known to be in order already.
  */
 void q_sort(struct list_head *head);
 
+/*
+ * Sort elements of queue in ascending order, like q_sort(), with a most
+ * significant digit first radix sort on the strings instead of a comparison
+ * sort. Better suited to large queues of short strings.
+ */
+void q_radix_sort(struct list_head *head);
+
 #endif /* LAB0_QUEUE_H */
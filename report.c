@@ -158,23 +158,52 @@ static void fail_fun(char *format, char *msg)
 }
 
 /* Maximum number of megabytes that application can use (0 = unlimited) */
-static int mblimit = 0;
+int mblimit = 0;
 
-/* Keeping track of memory allocation */
+/*
+ * Keeping track of memory allocation, both by the functions below and by
+ * the test harness through mem_reserve() and mem_release().
+ * The harness may be called from several threads, hence atomic updates.
+ */
 static size_t allocate_cnt = 0;
 static size_t allocate_bytes = 0;
 static size_t free_cnt = 0;
 static size_t free_bytes = 0;
 
-/* Counters giving peak memory usage */
+/* Counters giving peak memory usage, overall and during an operation */
 static size_t peak_bytes = 0;
 static size_t last_peak_bytes = 0;
 static size_t current_bytes = 0;
 
+/* Memory in use when the current operation started, and what the last
+ * finished operation left allocated and peaked at beyond its start
+ */
+static size_t op_start_bytes = 0;
+static long op_delta_bytes = 0;
+static size_t op_peak_bytes = 0;
+
+/* Count an allocation of bytes, which brought current usage to current */
+static void count_alloc(size_t bytes, size_t current)
+{
+    __atomic_fetch_add(&allocate_cnt, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&allocate_bytes, bytes, __ATOMIC_RELAXED);
+    raise_peak(&peak_bytes, current);
+    raise_peak(&last_peak_bytes, current);
+}
+
+/* Count a free of bytes */
+static void count_free(size_t bytes)
+{
+    __atomic_fetch_add(&free_cnt, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&free_bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&current_bytes, bytes, __ATOMIC_RELAXED);
+}
+
 static void check_exceed(size_t new_bytes)
 {
     size_t limit_bytes = (size_t) mblimit << 20;
-    size_t request_bytes = new_bytes + current_bytes;
+    size_t request_bytes =
+        new_bytes + __atomic_load_n(&current_bytes, __ATOMIC_RELAXED);
     if (mblimit > 0 && request_bytes > limit_bytes) {
         report_event(MSG_FATAL,
                      "Exceeded memory limit of %u megabytes with %lu bytes",
@@ -192,11 +221,8 @@ void *malloc_or_fail(size_t bytes, char *fun_name)
         return NULL;
     }
 
-    allocate_cnt++;
-    allocate_bytes += bytes;
-    current_bytes += bytes;
-    peak_bytes = MAX(peak_bytes, current_bytes);
-    last_peak_bytes = MAX(last_peak_bytes, current_bytes);
+    count_alloc(bytes,
+                __atomic_add_fetch(&current_bytes, bytes, __ATOMIC_RELAXED));
 
     return p;
 }
@@ -204,18 +230,16 @@ void *malloc_or_fail(size_t bytes, char *fun_name)
 /* Call calloc returns NULL & exit if fails */
 void *calloc_or_fail(size_t cnt, size_t bytes, char *fun_name)
 {
-    check_exceed(cnt * bytes);
+    size_t total = cnt * bytes;
+    check_exceed(total);
     void *p = calloc(cnt, bytes);
     if (!p) {
         fail_fun("Calloc returned NULL in %s", fun_name);
         return NULL;
     }
 
-    allocate_cnt++;
-    allocate_bytes += cnt * bytes;
-    current_bytes += cnt * bytes;
-    peak_bytes = MAX(peak_bytes, current_bytes);
-    last_peak_bytes = MAX(last_peak_bytes, current_bytes);
+    count_alloc(total,
+                __atomic_add_fetch(&current_bytes, total, __ATOMIC_RELAXED));
 
     return p;
 }
@@ -231,11 +255,8 @@ char *strsave_or_fail(char *s, char *fun_name)
     if (!ss)
         fail_fun("strsave failed in %s", fun_name);
 
-    allocate_cnt++;
-    allocate_bytes += len + 1;
-    current_bytes += len + 1;
-    peak_bytes = MAX(peak_bytes, current_bytes);
-    last_peak_bytes = MAX(last_peak_bytes, current_bytes);
+    count_alloc(len + 1,
+                __atomic_add_fetch(&current_bytes, len + 1, __ATOMIC_RELAXED));
 
     return strncpy(ss, s, len + 1);
 }
@@ -247,9 +268,7 @@ void free_block(void *b, size_t bytes)
         report_event(MSG_ERROR, "Attempting to free null block");
     free(b);
 
-    free_cnt++;
-    free_bytes += bytes;
-    current_bytes -= bytes;
+    count_free(bytes);
 }
 
 /* Free array, as from calloc */
@@ -259,9 +278,7 @@ void free_array(void *b, size_t cnt, size_t bytes)
         report_event(MSG_ERROR, "Attempting to free null block");
     free(b);
 
-    free_cnt++;
-    free_bytes += cnt * bytes;
-    current_bytes -= cnt * bytes;
+    count_free(cnt * bytes);
 }
 
 /* Free string saved by strsave_or_fail */
@@ -272,6 +289,49 @@ void free_string(char *s)
     free_block((void *) s, strlen(s) + 1);
 }
 
+bool mem_reserve(size_t bytes)
+{
+    size_t current =
+        __atomic_add_fetch(&current_bytes, bytes, __ATOMIC_RELAXED);
+
+    if (mblimit > 0 && current > (size_t) mblimit << 20) {
+        __atomic_fetch_sub(&current_bytes, bytes, __ATOMIC_RELAXED);
+        return false;
+    }
+    count_alloc(bytes, current);
+    return true;
+}
+
+void mem_release(size_t bytes)
+{
+    count_free(bytes);
+}
+
+void mem_op_begin()
+{
+    op_start_bytes = __atomic_load_n(&current_bytes, __ATOMIC_RELAXED);
+    __atomic_store_n(&last_peak_bytes, op_start_bytes, __ATOMIC_RELAXED);
+}
+
+void mem_op_end()
+{
+    size_t current = __atomic_load_n(&current_bytes, __ATOMIC_RELAXED);
+    op_delta_bytes = (long) (current - op_start_bytes);
+    op_peak_bytes = __atomic_load_n(&last_peak_bytes, __ATOMIC_RELAXED) -
+                    op_start_bytes;
+}
+
+void mem_report()
+{
+    report(1, "Current bytes = %lu, Peak bytes = %lu",
+           __atomic_load_n(&current_bytes, __ATOMIC_RELAXED),
+           __atomic_load_n(&peak_bytes, __ATOMIC_RELAXED));
+    report(1, "Allocations = %lu (%lu bytes), Frees = %lu (%lu bytes)",
+           allocate_cnt, allocate_bytes, free_cnt, free_bytes);
+    report(1, "Last operation: Delta bytes = %ld, Peak bytes above start = %lu",
+           op_delta_bytes, op_peak_bytes);
+}
+
 /* Initialization of timers */
 void init_time(double *timep)
 {
@@ -3,6 +3,7 @@
 
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 /* Default reporting level.  Must recompile when change */
 #ifndef RPT
@@ -49,6 +50,39 @@ void free_array(void *b, size_t cnt, size_t bytes);
 /* Free string saved by strsave_or_fail */
 void free_string(char *s);
 
+/** Memory accounting.  **/
+
+/* Maximum number of megabytes that application can use (0 = unlimited) */
+extern int mblimit;
+
+/*
+ * Count bytes allocated elsewhere, as by the test harness, along with those
+ * allocated above.  Return false, counting nothing, if that would exceed
+ * the memory limit.
+ */
+bool mem_reserve(size_t bytes);
+
+/* Count bytes counted by mem_reserve() as freed */
+void mem_release(size_t bytes);
+
+/* Raise *peak to at least value, even if several threads update it */
+static inline void raise_peak(size_t *peak, size_t value)
+{
+    size_t old = __atomic_load_n(peak, __ATOMIC_RELAXED);
+
+    while (value > old &&
+           !__atomic_compare_exchange_n(peak, &old, value, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/* Measure the memory use of an operation: call before and after it */
+void mem_op_begin();
+void mem_op_end();
+
+/* Report current and peak memory use, and that of the last operation */
+void mem_report();
+
 /** Time measurement.  **/
 
 /* Time counted as fp number in seconds */
@@ -16,6 +16,7 @@ class Tracer:
     verbLevel = 0
     autograde = False
     useValgrind = False
+    guard = 0
     colored = False
 
     traceDict = {
@@ -35,7 +36,15 @@ class Tracer:
         14: "trace-14-perf",
         15: "trace-15-perf",
         16: "trace-16-perf",
-        17: "trace-17-complexity"
+        17: "trace-17-complexity",
+        18: "trace-18-sorted",
+        19: "trace-19-realloc",
+        20: "trace-20-radix",
+        21: "trace-21-threads",
+        22: "trace-22-schedule",
+        23: "trace-23-intern",
+        24: "trace-24-udedup",
+        25: "trace-25-index"
     }
 
     traceProbs = {
@@ -60,6 +69,12 @@ class Tracer:
 
     maxScores = [0, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 5]
 
+    # Traces which only time the queue, and may run in fast mode
+    perfTraces = [14, 15, 16]
+
+    # Regression traces of the extensions, run but not graded
+    extraTraces = [18, 19, 20, 21, 22, 23, 24, 25]
+
     RED = '\033[91m'
     GREEN = '\033[92m'
     WHITE = '\033[0m'
@@ -69,12 +84,16 @@ class Tracer:
                  verbLevel=0,
                  autograde=False,
                  useValgrind=False,
+                 guard=0,
+                 fast=False,
                  colored=False):
         if qtest != "":
             self.qtest = qtest
         self.verbLevel = verbLevel
         self.autograde = autograde
         self.useValgrind = useValgrind
+        self.guard = guard
+        self.fast = fast
         self.colored = colored
 
     def printInColor(self, text, color):
@@ -89,6 +108,8 @@ class Tracer:
         fname = "%s/%s.cmd" % (self.traceDirectory, self.traceDict[tid])
         vname = "%d" % self.verbLevel
         clist = self.command + ["-v", vname, "-f", fname]
+        if self.fast and tid in self.perfTraces:
+            clist += ["-F"]
 
         try:
             retcode = subprocess.call(clist)
@@ -98,7 +119,8 @@ class Tracer:
         return retcode == 0
 
     def run(self, tid=0):
-        scoreDict = {k: 0 for k in self.traceDict.keys()}
+        scoreDict = {k: 0 for k in self.traceDict.keys()
+                     if not k in self.extraTraces}
         print("---\tTrace\t\tPoints")
         if tid == 0:
             tidList = self.traceDict.keys()
@@ -109,15 +131,27 @@ class Tracer:
             tidList = [tid]
         score = 0
         maxscore = 0
+        extras = 0
+        extrasPassed = 0
         if self.useValgrind:
             self.command = ['valgrind', self.qtest]
         else:
             self.command = [self.qtest]
+        if self.guard:
+            self.command += ["-g", "%d" % self.guard]
         for t in tidList:
             tname = self.traceDict[t]
             if self.verbLevel > 0:
                 print("+++ TESTING trace %s:" % tname)
             ok = self.runTrace(t)
+            if t in self.extraTraces:
+                if ok:
+                    self.printInColor("---\t%s\tok" % tname, self.GREEN)
+                else:
+                    self.printInColor("---\t%s\tfailed" % tname, self.RED)
+                extras += 1
+                extrasPassed += ok
+                continue
             maxval = self.maxScores[t]
             tval = maxval if ok else 0
             if tval < maxval:
@@ -131,6 +165,9 @@ class Tracer:
             self.printInColor("---\tTOTAL\t\t%d/%d" % (score, maxscore), self.RED)
         else:
             self.printInColor("---\tTOTAL\t\t%d/%d" % (score, maxscore), self.GREEN)
+        if extras:
+            color = self.GREEN if extrasPassed == extras else self.RED
+            self.printInColor("---\tEXTRA\t\t%d/%d passed" % (extrasPassed, extras), color)
         if self.autograde:
             # Generate JSON string
             jstring = '{"scores": {'
@@ -145,11 +182,13 @@ class Tracer:
 
 
 def usage(name):
-    print("Usage: %s [-h] [-p PROG] [-t TID] [-v VLEVEL] [--valgrind] [-c]" % name)
+    print("Usage: %s [-h] [-p PROG] [-t TID] [-v VLEVEL] [--valgrind] [--guard=MODE] [--fast] [-c]" % name)
     print("  -h        Print this message")
     print("  -p PROG   Program to test")
     print("  -t TID    Trace ID to test")
     print("  -v VLEVEL Set verbosity level (0-3)")
+    print("  --guard=MODE Run qtest in guard page mode MODE (1: after, 2: before)")
+    print("  --fast    Run the performance traces in fast mode, unless in guard page mode")
     print("  -c Enable colored text")
     sys.exit(0)
 
@@ -161,9 +200,11 @@ def run(name, args):
     levelFixed = False
     autograde = False
     useValgrind = False
+    guard = 0
+    fast = False
     colored = False
 
-    optlist, args = getopt.getopt(args, 'hp:t:v:A:c', ['valgrind'])
+    optlist, args = getopt.getopt(args, 'hp:t:v:A:c', ['valgrind', 'guard=', 'fast'])
     for (opt, val) in optlist:
         if opt == '-h':
             usage(name)
@@ -178,6 +219,10 @@ def run(name, args):
             autograde = True
         elif opt == '--valgrind':
             useValgrind = True
+        elif opt == '--guard':
+            guard = int(val)
+        elif opt == '--fast':
+            fast = True
         elif opt == '-c':
             colored = True
         else:
@@ -189,6 +234,8 @@ def run(name, args):
                verbLevel=vlevel,
                autograde=autograde,
                useValgrind=useValgrind,
+               guard=guard,
+               fast=fast,
                colored=colored)
     t.run(tid)
 
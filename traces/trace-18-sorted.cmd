@@ -0,0 +1,39 @@
+# Test of find, is, and range after insert_head and insert_tail undo a sort,
+# or lsort
+option fail 0
+option malloc 0
+new
+ih dolphin
+ih bear
+it gerbil
+it aardvark
+sort
+find dolphin
+ih zebra
+it cat
+find aardvark
+find zebra
+find cat
+find yak
+range bear dolphin
+find gerbil
+find cat
+it ant
+ih meerkat
+is eel
+find ant
+find eel
+find meerkat
+sort
+ih mole
+it hare
+find mole
+find hare
+range ant mole
+size
+reverse
+lsort
+it bat
+find bat
+find zebra
+free
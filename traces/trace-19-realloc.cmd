@@ -0,0 +1,19 @@
+# Test of realloc: grow in place, move, shrink, and fail leaving the block
+option fail 0
+option malloc 0
+new
+realloc 20
+realloc 32
+realloc 4096
+realloc 8
+realloc 0
+option malloc_every 2
+realloc 100
+realloc 8192 fail
+realloc 8192
+realloc 16384 fail
+realloc 24
+option malloc_every 0
+ih dolphin
+free
+realloc 0
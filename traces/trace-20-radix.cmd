@@ -0,0 +1,39 @@
+# Test of lrsort on strings sharing long prefixes, of different lengths
+option fail 0
+option malloc 0
+new
+lrsort
+ih gerbil
+lrsort
+ih bear
+ih bearcat
+ih be
+ih b
+it dolphin
+it aardvark
+it bear
+it zebra
+it abcdefghijklmnopqrstuvwxyz
+it abcdefghijklmnopqrstuvwxy
+it abcdefghijklmnopqrstuvwxyzz
+it abcdefghijklmnopqrstuvwxya
+lrsort
+rh aardvark
+rh abcdefghijklmnopqrstuvwxy
+rh abcdefghijklmnopqrstuvwxya
+rh abcdefghijklmnopqrstuvwxyz
+rh abcdefghijklmnopqrstuvwxyzz
+rh b
+rh be
+rh bear
+rh bear
+rh bearcat
+rt zebra
+reverse
+lrsort
+ih RAND 2000
+it gerbil 100
+lrsort
+reverse
+lrsort
+free
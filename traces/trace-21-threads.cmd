@@ -0,0 +1,28 @@
+# Test of lsort with several threads, on runs of equal and unequal lengths
+option fail 0
+option malloc 0
+new
+option threads 4
+ih RAND 20000
+lsort
+reverse
+lsort
+option threads 3
+it gerbil 2
+ih a 2
+lsort
+rh a
+rh a
+option threads 2
+ih RAND 100
+lsort
+option threads 8
+ih RAND 50000
+lsort
+free
+new
+option threads 4
+ih RAND 100
+lsort
+option threads 1
+free
@@ -0,0 +1,66 @@
+# Test of fault injection schedules: the same seed fails the same calls,
+# every Nth call fails, or only calls from a given site do
+option fail 50
+option malloc 0
+new
+option malloc_seed 7
+option malloc 40
+ih a
+ih b
+ih c
+ih d
+ih e
+ih f
+ih g
+ih h
+ih i
+ih j
+option malloc 0
+rh j
+rh g
+rh e
+rh d
+rh c
+option malloc_seed 7
+option malloc 40
+ih a
+ih b
+ih c
+ih d
+ih e
+ih f
+ih g
+ih h
+ih i
+ih j
+option malloc 0
+rh j
+rh g
+rh e
+rh d
+rh c
+option malloc_every 3
+ih a
+ih b
+ih c
+ih d
+ih e
+ih f
+option malloc_every 0
+rh e
+rh d
+rh b
+rh a
+# Only the strings too long to be kept inline are allocated at this site,
+# the malloc() of new_element()
+malloc_site queue.c:278
+ih gerbil
+ih xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx
+ih bear
+ih xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx
+malloc_site
+ih xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx
+rh xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx
+rh bear
+rh gerbil
+free
@@ -0,0 +1,39 @@
+# Test of queues sharing one copy of equal strings
+option fail 30
+option malloc 0
+option intern 1
+new
+ih gerbil
+ih bear
+ih gerbil
+it bear
+it gerbil 5
+it dolphin
+reverse
+swap
+sort
+rh bear
+rh bear
+rh dolphin
+rt gerbil
+dedup
+ih meerkat 3
+it meerkat
+ih bear
+udedup first
+rh bear
+rh meerkat
+ih RAND 1000
+it gerbil 1000
+sort
+dedup
+option malloc 25
+ih zebra 20
+it gerbil 20
+option malloc 0
+free
+option intern 0
+new
+ih gerbil 3
+dedup
+free
@@ -0,0 +1,39 @@
+# Test of udedup, deleting duplicate strings from a queue which is not sorted
+option fail 10
+option malloc 0
+new
+udedup
+udedup first
+it gerbil
+udedup
+it gerbil
+it bear
+it dolphin
+it bear
+it gerbil
+it gerbil
+it meerkat
+udedup first
+rh gerbil
+rh bear
+rh dolphin
+rh meerkat
+it gerbil
+it bear
+it dolphin
+it bear
+it gerbil
+it meerkat
+udedup
+rh dolphin
+rh meerkat
+ih RAND 2000
+it zebra 100
+ih zebra 100
+udedup first
+option malloc 100
+it bear
+udedup
+option malloc 0
+udedup
+free
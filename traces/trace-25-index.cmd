@@ -0,0 +1,41 @@
+# Test of get and delat, which access the queue by index
+option fail 0
+option malloc 0
+new
+get 0
+delat 0
+it gerbil
+it bear
+it dolphin
+it meerkat
+it zebra
+get 0
+get 2
+get 4
+get 5
+delat 2
+get 2
+delat 0
+delat 2
+delat 2
+get 1
+rh bear
+rh meerkat
+ih RAND 3000
+it gerbil
+ih bear
+get 0
+get 1500
+get 3001
+delat 3001
+delat 1500
+delat 2999
+delat 0
+get 2997
+reverse
+get 0
+sort
+get 1000
+dm
+delat 1500
+free